@@ -31,7 +31,6 @@ AT24C::AT24C( void ) : AT24C( AT24C_ADDRESS )
 
 AT24C::AT24C( uint8_t addr ) : eeprom_address( addr )
 {
-	Wire.begin();
 }
 
 uint8_t AT24C::get_error( void )
@@ -60,41 +59,54 @@ bool AT24C::read_buffer( uint16_t data_addr, uint8_t *data, uint8_t len )
 
 bool AT24C::read_page( uint16_t data_addr, uint8_t *data, uint8_t len )
 {
+	bool ok = false;
+
 	if ( len > max_page_size )
 		return false;
 
+	if ( !i2c_bus.lock( eeprom_address, i2c_priority_t::BACKGROUND, I2C_LOCK_TIMEOUT_MS ))
+		return false;
+
 	Wire.beginTransmission( eeprom_address );
 	Wire.write( ( data_addr >> 8 ) & 0xFF );
 	Wire.write(  data_addr & 0xFF );
 
-	if ( ( error = Wire.endTransmission( false )) != 0 )
-		return false;
+	if ( ( error = Wire.endTransmission( false )) == 0 ) {
 
-	Wire.requestFrom( eeprom_address, len );
-	if ( Wire.available() >= len ) {
+		Wire.requestFrom( eeprom_address, len );
+		if ( Wire.available() >= len ) {
 
-		for( uint8_t i = 0; i < len; data[i++] = Wire.read() );
-		return true;
+			for( uint8_t i = 0; i < len; data[i++] = Wire.read() );
+			ok = true;
+		}
 	}
 
-	return false;
+	i2c_bus.unlock( eeprom_address, ok );
+	return ok;
 }
 
 bool AT24C::write_page( uint16_t data_addr, const uint8_t *data, uint8_t len )
 {
+	bool ok = false;
+
 	if ( len > max_page_size )
 		return false;
 
+	if ( !i2c_bus.lock( eeprom_address, i2c_priority_t::BACKGROUND, I2C_LOCK_TIMEOUT_MS ))
+		return false;
+
 	Wire.beginTransmission( eeprom_address );
 	Wire.write( ( data_addr >> 8 ) & 0xFF );
 	Wire.write(  data_addr & 0xFF );
 
-	if ( Wire.write( data, len ) != len )
-		return false;
+	if ( Wire.write( data, len ) == len ) {
 
-	delay( 10 );
+		delay( 10 );
+		ok = (( error = Wire.endTransmission() ) == 0 );
+	}
 
-	return ( ( error = Wire.endTransmission() ) == 0 );
+	i2c_bus.unlock( eeprom_address, ok );
+	return ok;
 }
 
 bool AT24C::write_buffer( uint16_t data_addr, const uint8_t *data, uint8_t len )
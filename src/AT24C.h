@@ -24,6 +24,8 @@
 #include "Wire.h"
 #include <array>
 
+#include "i2c_bus.h"
+
 class AT24C {
 
 	private:
@@ -54,6 +56,10 @@ bool AT24C::read( uint16_t data_addr, T *data )
 {
 	constexpr size_t			size = sizeof( T );
 	std::array<uint8_t,size>	buffer;
+	bool						ok;
+
+	if ( !i2c_bus.lock( eeprom_address, i2c_priority_t::BACKGROUND, I2C_LOCK_TIMEOUT_MS ))
+		return false;
 
 	Wire.beginTransmission( eeprom_address );
 	Wire.write( ( data_addr >> 8 ) & 0xFF );
@@ -61,15 +67,15 @@ bool AT24C::read( uint16_t data_addr, T *data )
 
 	delay( 10 );
 
-	if ( ( error = Wire.endTransmission() ) != 0 )
-		return false;
+	ok = (( error = Wire.endTransmission() ) == 0 ) && ( Wire.requestFrom( eeprom_address, size ) == size );
+	if ( ok )
+		for ( size_t i = 0; ( i < size ) && Wire.available(); i++ )
+			buffer[ i ] = Wire.read();
 
-	if ( Wire.requestFrom( eeprom_address, size ) != size )
+	i2c_bus.unlock( eeprom_address, ok );
+	if ( !ok )
 		return false;
 
-	for ( size_t i = 0; ( i < size ) && Wire.available(); i++ )
-		buffer[ i ] = Wire.read();
-
 	memcpy( data, buffer.data(), size );
 
 	return true;
@@ -118,6 +118,16 @@ void AWSNetwork::empty_queue( void )
 	lorawan.empty_queue();
 }
 
+uint32_t AWSNetwork::get_lorawan_airtime_ms( uint8_t len )
+{
+	return lorawan.get_airtime_ms( len );
+}
+
+uint8_t AWSNetwork::get_lorawan_max_payload( void )
+{
+	return lorawan.get_max_payload();
+}
+
 uint8_t *AWSNetwork::get_wifi_mac( void )
 {
 	return wifi_mac;
@@ -172,7 +182,7 @@ bool AWSNetwork::initialise_wifi( void )
 
 bool AWSNetwork::is_wifi_connected( void )
 {
-	const char  *ssid       = config->get_parameter<const char *>( "wifi_sta_ssid" );
+	const char  *ssid       = config->get_compiled_config().wifi_sta_ssid.data();
 
     return (( WiFi.status () == WL_CONNECTED ) && !strcmp( ssid, WiFi.SSID().c_str() ));
 }
@@ -241,11 +251,12 @@ void AWSNetwork::request_lorawan_network_time( void )
 	lorawan.request_network_time();
 }
 
-void AWSNetwork::send_raw_data( uint8_t *buffer, uint8_t len )
+bool AWSNetwork::send_raw_data( uint8_t *buffer, uint8_t len )
 {
+	WAKE_TRACE( wake_phase_t::LORAWAN_TX );
+
 	UNSELECT_SPI_DEVICES();
-	if ( lorawan.join() )
-		lorawan.send_data( buffer, len );
+	return lorawan.join() && lorawan.send_data( buffer, len );
 }
 
 void AWSNetwork::set_LoRaWAN_joined( bool b )
@@ -52,6 +52,8 @@ class AWSNetwork {
 		IPAddress	cidr_to_mask( byte cidr );
 		bool 		connect_to_wifi( void );
 		void		empty_queue( void );
+		uint32_t	get_lorawan_airtime_ms( uint8_t );
+		uint8_t		get_lorawan_max_payload( void );
 		uint8_t		*get_wifi_mac( void );
 		bool		has_joined( void );
 		void		initialise( AWSConfig *, bool );
@@ -62,7 +64,7 @@ class AWSNetwork {
 		void		queue_message( uint8_t, uint64_t );
 		void		prepare_for_deep_sleep( int );
 		void		request_lorawan_network_time( void );
-		void		send_raw_data( uint8_t *, uint8_t );
+		bool		send_raw_data( uint8_t *, uint8_t );
 		void		set_LoRaWAN_joined( bool );
 		bool		start_hotspot( void );
 
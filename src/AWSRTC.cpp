@@ -24,8 +24,7 @@
 #include <HardwareSerial.h>
 
 #include "AWSRTC.h"
-
-const uint8_t DS3231_I2C_ADDRESS = 0x68;
+#include "i2c_bus.h"
 
 uint8_t AWSRTC::bcd_to_decimal( uint8_t i )
 {
@@ -39,9 +38,12 @@ uint8_t AWSRTC::decimal_to_bcd( uint8_t i )
 
 bool AWSRTC::begin( void )
 {
-	Wire.begin();
+	if ( !i2c_bus.lock( DS3231_I2C_ADDRESS, i2c_priority_t::URGENT, I2C_LOCK_TIMEOUT_MS ))
+		return false;
+
 	Wire.beginTransmission( DS3231_I2C_ADDRESS );
 	uint8_t error = Wire.endTransmission();
+	i2c_bus.unlock( DS3231_I2C_ADDRESS, error == 0 );
 	return ( error == 0 );
 }
 
@@ -49,6 +51,10 @@ void AWSRTC::set_datetime( time_t *now )
 {
 	struct tm	dummy;
 	struct tm	*utc_time = gmtime_r( now, &dummy );
+	uint8_t		error;
+
+	if ( !i2c_bus.lock( DS3231_I2C_ADDRESS, i2c_priority_t::URGENT, I2C_LOCK_TIMEOUT_MS ))
+		return;
 
 	Wire.beginTransmission( DS3231_I2C_ADDRESS );
 	Wire.write( 0 );
@@ -59,16 +65,30 @@ void AWSRTC::set_datetime( time_t *now )
 	Wire.write( decimal_to_bcd( utc_time->tm_mday ));
 	Wire.write( decimal_to_bcd( utc_time->tm_mon ) + 1 );
 	Wire.write( decimal_to_bcd( utc_time->tm_year - 100 ));
-	if ( Wire.endTransmission() == 0 )
+	error = Wire.endTransmission();
+	i2c_bus.unlock( DS3231_I2C_ADDRESS, error == 0 );
+	if ( error == 0 )
 		Serial.printf( "[RTC       ] [INFO ] Setting time: %04d-%02d-%02d %02d:%02d:%02d\n", 1900+utc_time->tm_year, utc_time->tm_mon + 1, utc_time->tm_mday, utc_time->tm_hour, utc_time->tm_min, utc_time->tm_sec );
 }
 
-void AWSRTC::get_datetime( struct tm *utc_time )
+// utc_time is left untouched if the RTC cannot be read
+bool AWSRTC::get_datetime( struct tm *utc_time )
 {
+	uint8_t received;
+
+	if ( !i2c_bus.lock( DS3231_I2C_ADDRESS, i2c_priority_t::URGENT, I2C_LOCK_TIMEOUT_MS ))
+		return false;
+
 	Wire.beginTransmission( DS3231_I2C_ADDRESS );
 	Wire.write( 0 );
 	Wire.endTransmission();
-	Wire.requestFrom( DS3231_I2C_ADDRESS, static_cast<uint8_t>(7) );
+	received = Wire.requestFrom( DS3231_I2C_ADDRESS, static_cast<uint8_t>(7) );
+	if ( received != 7 ) {
+
+		i2c_bus.unlock( DS3231_I2C_ADDRESS, false );
+		return false;
+	}
+
 	utc_time->tm_sec = bcd_to_decimal( Wire.read() & 0x7F );
 	utc_time->tm_min = bcd_to_decimal( Wire.read() );
 	utc_time->tm_hour = bcd_to_decimal( Wire.read() & 0x3F );
@@ -76,4 +96,6 @@ void AWSRTC::get_datetime( struct tm *utc_time )
 	utc_time->tm_mday = bcd_to_decimal( Wire.read() );
 	utc_time->tm_mon = bcd_to_decimal( Wire.read() - 1 );
 	utc_time->tm_year = 100 + bcd_to_decimal( Wire.read() );
+	i2c_bus.unlock( DS3231_I2C_ADDRESS, true );
+	return true;
 }
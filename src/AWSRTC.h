@@ -23,6 +23,7 @@
 #ifndef _AWSRTC_h
 #define _AWSRTC_h
 
+const uint8_t DS3231_I2C_ADDRESS = 0x68;
 
 class AWSRTC
 {
@@ -35,7 +36,7 @@ class AWSRTC
 	public:
 				AWSRTC( void ) = default;
 		bool	begin( void );
-		void	get_datetime( struct tm * );
+		bool	get_datetime( struct tm * );
 		void	set_datetime( time_t * );
 
 };
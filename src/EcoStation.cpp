@@ -32,6 +32,7 @@
 #include <LittleFS.h>
 #include <charconv>
 #include <optional>
+#include <algorithm>
 
 #include "Embedded_Template_Library.h"
 #include "etl/string.h"
@@ -40,14 +41,14 @@
 #include "defaults.h"
 #include "gpio_config.h"
 #include "common.h"
+#include "i2c_bus.h"
 #include "sensor_manager.h"
 #include "config_manager.h"
 #include "config_server.h"
 #include "AWSNetwork.h"
+#include "json_writer.h"
 #include "EcoStation.h"
 
-extern SemaphoreHandle_t	sensors_read_mutex;
-
 const std::array<etl::string<10>, 3> PWR_MODE_STR = { "SolarPanel", "12VDC", "PoE" };
 
 const bool				FORMAT_LITTLEFS_IF_FAILED = true;
@@ -58,7 +59,11 @@ RTC_DATA_ATTR time_t 	boot_timestamp = 0;				// NOSONAR
 RTC_DATA_ATTR time_t 	last_ntp_time = 0;				// NOSONAR
 RTC_DATA_ATTR uint16_t	ntp_time_misses = 0;			// NOSONAR
 RTC_DATA_ATTR uint16_t 	low_battery_event_count = 0;	// NOSONAR
+RTC_DATA_ATTR bool		unavailable_sensors_reported = false;	// NOSONAR
 RTC_NOINIT_ATTR bool	ota_update_ongoing = false;		// NOSONAR
+RTC_DATA_ATTR firmware_sha256_cache_t	firmware_sha256_cache;	// NOSONAR
+RTC_DATA_ATTR uint16_t	uplink_count = 0;				// NOSONAR
+RTC_DATA_ATTR lora_batch_t	lora_batch;					// NOSONAR
 
 EcoStation::EcoStation( void )
 {
@@ -66,8 +71,8 @@ EcoStation::EcoStation( void )
 	station_data.health.current_heap_size = station_data.health.init_heap_size;
 	station_data.health.largest_free_heap_block = heap_caps_get_largest_free_block( MALLOC_CAP_8BIT );
 	location = DEFAULT_LOCATION;
-	compact_data.format_version = COMPACT_DATA_FORMAT_VERSION;
-	compact_data.build_info =  (( BUILD_ID[0] - '0' ) * 1000000000 ) + (( BUILD_ID[1] - '0') * 100000000) +\
+	json_mutex = xSemaphoreCreateMutex();
+	build_info =  (( BUILD_ID[0] - '0' ) * 1000000000 ) + (( BUILD_ID[1] - '0') * 100000000) +\
 							(( BUILD_ID[2] - '0') * 10000000) + (( BUILD_ID[3] - '0') * 1000000 ) +\
 							(( BUILD_ID[4] - '0') * 100000 ) + (( BUILD_ID[5] - '0') * 10000 ) +\
 							(( BUILD_ID[6] - '0') * 1000 ) + (( BUILD_ID[7] - '0') * 100 ) +\
@@ -77,7 +82,37 @@ EcoStation::EcoStation( void )
 bool EcoStation::activate_sensors( void )
 {
 	Serial.printf( "[STATION   ] [INFO ] Activating sensors.\n" );
-	return ( ready = sensor_manager.initialise( &config, &compact_data, true ));
+	return ( ready = sensor_manager.initialise( &config, true ));
+}
+
+//
+// Returns false, leaving the batch untouched, if the reading in compact_data cannot be delta encoded against the batch or
+// does not fit. A forced reading is kept anyway, a full batch (left by failed uplinks) then loses its oldest reading.
+//
+bool EcoStation::add_to_lora_batch( size_t len, bool force )
+{
+	std::array<const uint8_t *, LORA_BATCH_MAX_SIZE>	frames;
+
+	if ( lora_batch.count == LORA_BATCH_MAX_SIZE ) {
+
+		if ( !force )
+			return false;
+
+		Serial.printf( "[STATION   ] [ERROR] LoRaWAN batch is full, dropping its oldest reading.\n" );
+		drop_from_lora_batch( 1 );
+	}
+
+	lora_batch.size[ lora_batch.count ] = len;
+	memcpy( lora_batch.frame[ lora_batch.count ].data(), compact_data.data(), len );
+
+	for ( uint8_t i = 0; i <= lora_batch.count; i++ )
+		frames[ i ] = lora_batch.frame[ i ].data();
+
+	if ( !force && lora_batch.count && !payload_encode_batch( frames.data(), lora_batch.size.data(), lora_batch.count + 1, uplink_data.data(), uplink_max_size ))
+		return false;
+
+	lora_batch.count++;
+	return true;
 }
 
 void EcoStation::check_ota_updates( bool force_update = false )
@@ -99,6 +134,7 @@ void EcoStation::check_ota_updates( bool force_update = false )
 													ota_setup.version,
 													force_update ? ota_action_t::UPDATE_AND_BOOT : ota_action_t::CHECK_ONLY );
 	ota_update_ongoing = false;
+	station_data_generation++;
 }
 
 void EcoStation::determine_boot_mode( void )
@@ -179,6 +215,11 @@ void EcoStation::display_banner()
 	Serial.printf( "[STATION   ] [INFO ] #############################################################################################\n" );
 }
 
+size_t EcoStation::encode_compact_data( void )
+{
+	return payload_encode( *payload_get_schema( COMPACT_DATA_FORMAT_VERSION ), [this]( payload_field_t field ) { return get_payload_value( uplink_snapshot, field ); }, compact_data.data(), compact_data.size() );
+}
+
 bool EcoStation::enter_maintenance_mode( void )
 {
 	if ( debug_mode )
@@ -216,8 +257,6 @@ void EcoStation::factory_reset( void )
 
 bool EcoStation::fixup_timestamp( void )
 {
-	aws_device_t devs = compact_data.available_sensors;
-
 	if ( !config.get_has_device( aws_device_t::RTC_DEVICE )) {
 
 		Serial.printf( "[STATION   ] [INFO ] RTC not present.\n");
@@ -232,8 +271,14 @@ bool EcoStation::fixup_timestamp( void )
 		return false;
 	}
 
-	struct tm timeinfo;
-	aws_rtc.get_datetime( &timeinfo );
+	struct tm timeinfo = {};
+	if ( !aws_rtc.get_datetime( &timeinfo )) {
+
+		Serial.printf( "[STATION   ] [ERROR] Could not read the RTC time.\n");
+		sensor_manager.update_available_sensors( aws_device_t::RTC_DEVICE, false );
+		return false;
+	}
+
 	time_t now = mktime( &timeinfo );
 	struct timeval now2 = { .tv_sec = now };
 	settimeofday( &now2, NULL );
@@ -246,6 +291,58 @@ bool EcoStation::fixup_timestamp( void )
 	return true;
 }
 
+// Readings already sent leave the batch, the others move to its front
+void EcoStation::drop_from_lora_batch( uint8_t count )
+{
+	count = std::min( count, lora_batch.count );
+	for ( uint8_t i = count; i < lora_batch.count; i++ ) {
+
+		lora_batch.size[ i - count ] = lora_batch.size[ i ];
+		lora_batch.frame[ i - count ] = lora_batch.frame[ i ];
+	}
+	lora_batch.count -= count;
+}
+
+//
+// The data rate may have dropped since the readings were batched: each uplink takes as many of the oldest readings as fit
+// at the current one, down to a single reading which always fits. Readings only leave the batch once their uplink is sent.
+// Returns false if some readings are still waiting.
+//
+bool EcoStation::flush_lora_batch( void )
+{
+	std::array<const uint8_t *, LORA_BATCH_MAX_SIZE>	frames;
+	size_t												len		= 0;
+	uint8_t												n;
+
+	uplink_max_size = network.get_lorawan_max_payload();
+
+	while ( lora_batch.count ) {
+
+		for ( uint8_t i = 0; i < lora_batch.count; i++ )
+			frames[ i ] = lora_batch.frame[ i ].data();
+
+		for ( n = lora_batch.count; n > 1; n-- )
+			if (( len = payload_encode_batch( frames.data(), lora_batch.size.data(), n, uplink_data.data(), uplink_max_size )))
+				break;
+
+		if ( n == 1 ) {
+
+			len = lora_batch.size[0];
+			memcpy( uplink_data.data(), lora_batch.frame[0].data(), len );
+		}
+
+		if ( !send_uplink( uplink_data.data(), len, n )) {
+
+			Serial.printf( "[STATION   ] [ERROR] %d reading(s) kept for the next uplink.\n", lora_batch.count );
+			return false;
+		}
+
+		drop_from_lora_batch( n );
+		uplink_count++;
+	}
+	return true;
+}
+
 template<typename... Args>
 etl::string<96> EcoStation::format_helper( const char *fmt, Args... args )
 {
@@ -259,62 +356,128 @@ AWSConfig &EcoStation::get_config( void )
 	return config;
 }
 
-etl::string_view EcoStation::get_json_sensor_data( void )
-{
-	JsonDocument		json_data;
-	sensor_data_t		*sensor_data = sensor_manager.get_sensor_data();
-	int					l;
-
-	json_data["available_sensors"] = static_cast<unsigned long>( sensor_data->available_sensors );
-	json_data["battery_level"] = station_data.health.battery_level;
-	json_data["timestamp"] = sensor_data->timestamp;
-	json_data["temperature"] = sensor_data->weather.temperature;
-	json_data["pressure"] = sensor_data->weather.pressure;
-	json_data["sl_pressure"] = sensor_data->weather.sl_pressure;
-	json_data["rh"] = sensor_data->weather.rh;
-	json_data["db"] = sensor_data->db;
-	json_data["ota_board"] = ota_setup.board.data();
-	json_data["ota_device"] = ota_setup.device.data();
-	json_data["ota_config"] = ota_setup.config.data();
-	json_data["build_id" ] = ota_setup.version.data();
-	json_data["dew_point"] = sensor_data->weather.dew_point;
-	json_data["raw_sky_temperature"] = sensor_data->weather.raw_sky_temperature;
-	json_data["sky_temperature"] = sensor_data->weather.sky_temperature;
-	json_data["ambient_temperature"] = sensor_data->weather.ambient_temperature;
-	json_data["cloud_coverage"] = sensor_data->weather.cloud_coverage;
-	json_data["msas"] = sensor_data->sqm.msas;
-	json_data["nelm"] = sensor_data->sqm.nelm;
-	json_data["integration_time"] = sensor_data->sqm.integration_time;
-	json_data["gain"] = sensor_data->sqm.gain;
-	json_data["ir_luminosity"] = sensor_data->sqm.ir_luminosity;
-	json_data["full_luminosity"] = sensor_data->sqm.full_luminosity;
-	json_data["lux"] = sensor_data->sun.lux;
-	json_data["irradiance"] = sensor_data->sun.irradiance;
-	json_data["ntp_time_sec"] = station_data.ntp_time.tv_sec;
-	json_data["ntp_time_usec"] = station_data.ntp_time.tv_usec;
-	json_data["uptime"] = get_uptime();
-	json_data["init_heap_size"] = station_data.health.init_heap_size;
-	json_data["current_heap_size"] = station_data.health.current_heap_size;
-	json_data["largest_free_heap_block" ] = station_data.health.largest_free_heap_block;
-	json_data["ota_code" ] = static_cast<int>( ota_setup.status_code );
-	json_data["ota_status_ts" ] = ota_setup.status_ts;
-	json_data["ota_last_update_ts" ] = ota_setup.last_update_ts;
-	json_data["reset_reason"] = station_data.reset_reason;
-
-	if ( ( l = measureJson( json_data )) > json_sensor_data.capacity() ) {
-
-		etl::string<64> tmp;
-		snprintf( tmp.data(), tmp.capacity(), "sensor_data json is too small ( %d > %d )", l, json_sensor_data.capacity() );
-		send_alarm( "[STATION] BUG", tmp.data() );
-		Serial.printf( "[STATION   ] [BUG  ] sensor_data json is too small ( %d > %d ). Please report to support!\n", l, json_sensor_data.capacity() );
-		return etl::string_view( "" );
-
-	}
-	json_sensor_data_len = serializeJson( json_data, json_sensor_data.data(), json_sensor_data.capacity() );
+//
+// Hashing the whole running partition takes a significant share of a solar wake, so the digest
+// is cached in RTC memory (backed by NVS) and keyed by partition address and build ID.
+// It is only recomputed after a cold reset or when the running partition changed (e.g. after an OTA update).
+//
+void EcoStation::get_firmware_sha256( void )
+{
+	WAKE_TRACE( wake_phase_t::FIRMWARE_SHA );
+
+	const esp_partition_t	*partition	= esp_ota_get_running_partition();
+	esp_reset_reason_t		reason		= esp_reset_reason();
+	bool					cached		= false;
+
+	auto is_valid = [partition]( const firmware_sha256_cache_t &cache ) {
+		return (( cache.partition_address == partition->address ) && !strncmp( cache.build_id.data(), BUILD_ID, cache.build_id.size() ));
+	};
+
+	if (( reason == ESP_RST_DEEPSLEEP ) || ( reason == ESP_RST_SW )) {
+
+		if ( !( cached = is_valid( firmware_sha256_cache ))) {
+
+			Preferences nvs;
+			nvs.begin( "firmware", true );
+			cached = ( nvs.getBytes( "sha256_cache", &firmware_sha256_cache, sizeof( firmware_sha256_cache_t )) == sizeof( firmware_sha256_cache_t )) && is_valid( firmware_sha256_cache );
+			nvs.end();
+		}
+	}
+
+	if ( !cached ) {
+
+		esp_partition_get_sha256( partition, firmware_sha256_cache.sha256.data() );
+		firmware_sha256_cache.partition_address = partition->address;
+		strlcpy( firmware_sha256_cache.build_id.data(), BUILD_ID, firmware_sha256_cache.build_id.size() );
+
+		Preferences nvs;
+		nvs.begin( "firmware", false );
+		nvs.putBytes( "sha256_cache", &firmware_sha256_cache, sizeof( firmware_sha256_cache_t ));
+		nvs.end();
+	}
+
+	station_data.firmware_sha56.clear();
+	for ( uint8_t _byte : firmware_sha256_cache.sha256 ) {
+
+		etl::string<3> h;
+		snprintf( h.data(), 3, "%02x", _byte );
+		station_data.firmware_sha56 += h.data();
+	}
+
 	if ( debug_mode )
-		Serial.printf( "[STATION   ] [DEBUG] sensor_data is %d bytes long, max size is %d bytes.\n", json_sensor_data_len, json_sensor_data.capacity() );
+		Serial.printf( "[STATION   ] [DEBUG] Firmware checksum %s.\n", cached ? "taken from cache" : "computed" );
+}
 
-	return etl::string_view( json_sensor_data );
+// Changes with the sensor readings and the station data, without rendering the JSON
+etl::string<24> EcoStation::get_json_sensor_data_etag( void )
+{
+	etl::string<24> etag;
+
+	snprintf( etag.data(), etag.capacity(), "\"%08lx%08lx\"", static_cast<unsigned long>( sensor_manager.get_data_generation() ), static_cast<unsigned long>( station_data_generation ));
+	etag.uninitialized_resize( strlen( etag.data() ));
+	return etag;
+}
+
+// Static health data only goes with the first reading of an uplink
+uint8_t EcoStation::get_payload_sections( void )
+{
+	uint8_t sections = 0;
+
+	if ( lora_batch.count )
+		return 0;
+
+	if ( !( uplink_count % EXTENDED_HEALTH_UPLINK_PERIOD ))
+		sections |= PAYLOAD_SECTION_EXTENDED_HEALTH;
+
+	if ( config.get_compiled_config().spl_spectrum && sensor_manager.sensor_is_available( aws_device_t::SPL_SENSOR ) && !( uplink_count % SPECTRUM_UPLINK_PERIOD ))
+		sections |= PAYLOAD_SECTION_SPECTRUM;
+
+	return sections;
+}
+
+double EcoStation::get_payload_value( const sensor_data_t &sensor_data, payload_field_t field )
+{
+	switch ( field ) {
+
+		case payload_field_t::FORMAT_VERSION:		return COMPACT_DATA_FORMAT_VERSION;
+		case payload_field_t::SECTIONS:				return payload_sections;
+		case payload_field_t::TIMESTAMP:			return sensor_data.timestamp;
+		case payload_field_t::LUX:					return sensor_data.sun.lux;
+		case payload_field_t::IRRADIANCE:			return sensor_data.sun.irradiance;
+		case payload_field_t::TEMPERATURE:			return sensor_data.weather.temperature;
+		case payload_field_t::PRESSURE:				return sensor_data.weather.pressure;
+		case payload_field_t::RH:					return sensor_data.weather.rh;
+		case payload_field_t::AMBIENT_TEMPERATURE:	return sensor_data.weather.ambient_temperature;
+		case payload_field_t::RAW_SKY_TEMPERATURE:	return sensor_data.weather.raw_sky_temperature;
+		case payload_field_t::SKY_TEMPERATURE:		return sensor_data.weather.sky_temperature;
+		case payload_field_t::CLOUD_COVER:			return sensor_data.weather.cloud_cover;
+		case payload_field_t::CLOUD_COVERAGE:		return sensor_data.weather.cloud_coverage;
+		case payload_field_t::MSAS:					return sensor_data.sqm.msas;
+		case payload_field_t::NELM:					return sensor_data.sqm.nelm;
+		case payload_field_t::DB:					return sensor_data.db;
+		case payload_field_t::LEQ:					return sensor_data.noise.leq;
+		case payload_field_t::L10:					return sensor_data.noise.l10;
+		case payload_field_t::L50:					return sensor_data.noise.l50;
+		case payload_field_t::L90:					return sensor_data.noise.l90;
+		case payload_field_t::LMAX:					return sensor_data.noise.lmax;
+		case payload_field_t::OCTAVE_0:				return sensor_data.noise.octaves[0];
+		case payload_field_t::OCTAVE_1:				return sensor_data.noise.octaves[1];
+		case payload_field_t::OCTAVE_2:				return sensor_data.noise.octaves[2];
+		case payload_field_t::OCTAVE_3:				return sensor_data.noise.octaves[3];
+		case payload_field_t::OCTAVE_4:				return sensor_data.noise.octaves[4];
+		case payload_field_t::OCTAVE_5:				return sensor_data.noise.octaves[5];
+		case payload_field_t::OCTAVE_6:				return sensor_data.noise.octaves[6];
+		case payload_field_t::AVAILABLE_SENSORS:	return static_cast<unsigned long>( sensor_data.available_sensors );
+		case payload_field_t::BATTERY_LEVEL:		return station_data.health.battery_level;
+		case payload_field_t::UPTIME:				return get_uptime();
+		case payload_field_t::FS_FREE_SPACE:		return station_data.health.fs_free_space;
+		case payload_field_t::RESET_REASON:			return station_data.reset_reason;
+		case payload_field_t::BUILD_INFO:			return build_info;
+		case payload_field_t::SLEEP_MINUTES:		return config.get_compiled_config().sleep_minutes;
+	}
+
+	Serial.printf( "[STATION   ] [BUG  ] No source for payload field %d.\n", static_cast<int>( field ));
+	return 0;
 }
 
 uint32_t EcoStation::get_uptime( void )
@@ -335,50 +498,66 @@ uint32_t EcoStation::get_uptime( void )
   		} else
 
   			station_data.health.uptime = now - boot_timestamp;
-
-  		compact_data.uptime = station_data.health.uptime;
   	}
 
 	return station_data.health.uptime;
 }
 
+//
+// Renders the JSON if needed and keeps it as is until release_json_sensor_data(), so that an HTTP response can read
+// it in parts with read_json_sensor_data(). Returns its length, 0 if it could not be rendered (then nothing is held).
+//
+size_t EcoStation::hold_json_sensor_data( etl::string<24> &etag )
+{
+	size_t len;
+
+	xSemaphoreTake( json_mutex, portMAX_DELAY );
+	if (( len = render_json_sensor_data().size() ))
+		json_sensor_readers++;
+	snprintf( etag.data(), etag.capacity(), "\"%08lx%08lx\"", static_cast<unsigned long>( json_sensor_generation ), static_cast<unsigned long>( json_station_generation ));
+	etag.uninitialized_resize( strlen( etag.data() ));
+	xSemaphoreGive( json_mutex );
+
+	return len;
+}
+
 bool EcoStation::initialise( void )
 {
 	std::array<uint8_t, 6>	mac;
 	byte					offset = 0;
-	std::array<uint8_t, 32>	sha_256;
 
-	determine_boot_mode();
+#if WAKE_TRACING
+	WakeTracer::begin( esp_reset_reason() == ESP_RST_DEEPSLEEP );
+#endif
 
-	esp_partition_get_sha256( esp_ota_get_running_partition(), sha_256.data() );
-	for ( uint8_t _byte : sha_256 ) {
+	determine_boot_mode();
 
-		etl::string<3> h;
-		snprintf( h.data(), 3, "%02x", _byte );
-		station_data.firmware_sha56 += h.data();
-	}
+	get_firmware_sha256();
 
 	Serial.printf( "\n\n[STATION   ] [INFO ] Firmware checksum = [%s]\n", station_data.firmware_sha56.data() );
 	Serial.printf( "[STATION   ] [INFO ] EcoStation [REV %s, BUILD %s, BASE %s] is booting...\n", REV.data(), BUILD_ID, GITHASH );
 
 	station_data.reset_reason = esp_reset_reason();
-	compact_data.reset_reason = station_data.reset_reason;
 
 	pinMode( GPIO_ENABLE_3_3V, OUTPUT );
 	digitalWrite( GPIO_ENABLE_3_3V, HIGH );
 
-	if ( !config.load( station_data.firmware_sha56, debug_mode ) )
+	if ( !i2c_bus.begin() )
+		Serial.printf( "[STATION   ] [ERROR] Could not start the I2C bus.\n" );
+
+	{
+		WAKE_TRACE( wake_phase_t::CONFIG_LOAD );
+
+		if ( !config.load( station_data.firmware_sha56, debug_mode ) )
 			return false;
+	}
 
 	if ( solar_panel )
 		digitalWrite( GPIO_ENABLE_3_3V, LOW );
 
 	station_data.health.fs_free_space = config.get_fs_free_space();
-	compact_data.fs_free_space = station_data.health.fs_free_space;
 	Serial.printf( "[STATION   ] [INFO ] Free space on config partition: %d bytes\n", station_data.health.fs_free_space );
 
-	compact_data.sleep_minutes = config.get_parameter<uint16_t>( "sleep_minutes" );
-
 	solar_panel = ( static_cast<aws_pwr_src>( config.get_pwr_mode()) == aws_pwr_src::panel );
 	sensor_manager.set_solar_panel( solar_panel );
 	sensor_manager.set_debug_mode( debug_mode );
@@ -407,12 +586,17 @@ bool EcoStation::initialise( void )
 	ota_setup.version += ".";
 	ota_setup.version += BUILD_ID;
 
+	render_json_static_fields();
+
 	if ( boot_mode == aws_boot_mode_t::FACTORY_RESET )
 		factory_reset();
 
 	read_battery_level();
 
-	network.initialise( &config, debug_mode );
+	{
+		WAKE_TRACE( wake_phase_t::NETWORK );
+		network.initialise( &config, debug_mode );
+	}
 
 	if ( solar_panel ) {
 
@@ -443,7 +627,7 @@ bool EcoStation::initialise( void )
 
 	display_banner();
 
-	if ( !sensor_manager.initialise( &config, &compact_data, false ))
+	if ( !sensor_manager.initialise( &config, false ))
 		return false;
 
 	if ( solar_panel )
@@ -465,6 +649,36 @@ bool EcoStation::is_ready( void )
 	return ready;
 }
 
+//
+// Compares the reading being sent with the first one of the batch, decoded from its frame: a field that moved by more
+// than its threshold, or a battery level that fell to the alarm level, means the batch cannot wait.
+//
+bool EcoStation::lora_batch_threshold_crossed( void )
+{
+	bool		crossed = false;
+	uint32_t	sensors = static_cast<uint32_t>( uplink_snapshot.available_sensors );
+
+	if ( !lora_batch.count )
+		return false;
+
+	payload_decode( lora_batch.frame[0].data(), lora_batch.size[0], [this, sensors, &crossed]( uint8_t reading, const payload_field_desc_t &desc, double value ) {
+
+		if ( reading || (( sensors & desc.required_sensors ) != desc.required_sensors ))
+			return;
+
+		double now = get_payload_value( uplink_snapshot, desc.field );
+
+		if (( desc.field == payload_field_t::BATTERY_LEVEL ) && ( value > BAT_LEVEL_MIN ) && ( now <= BAT_LEVEL_MIN ))
+			crossed = true;
+
+		for ( const lora_batch_threshold_t &threshold : LORA_BATCH_FLUSH_THRESHOLDS )
+			if (( threshold.field == desc.field ) && ( fabs( now - value ) >= threshold.change ))
+				crossed = true;
+	});
+
+	return crossed;
+}
+
 void EcoStation::LoRaWAN_message_sent( void )
 {
 	network.LoRaWAN_message_sent();
@@ -601,6 +815,7 @@ void EcoStation::periodic_tasks( void *dummy )	// NOSONAR
 
 			station_data.health.current_heap_size =	xPortGetFreeHeapSize();
 			station_data.health.largest_free_heap_block = heap_caps_get_largest_free_block( MALLOC_CAP_8BIT );
+			station_data_generation++;
 			sync_time( false );
 			sync_time_millis = millis();
 		}
@@ -612,10 +827,21 @@ void EcoStation::periodic_tasks( void *dummy )	// NOSONAR
 			ota_millis = millis();
 		}
 
+		// Sensors taken out or back after failed reads
+		if ( sensor_manager.availability_changed() )
+			report_unavailable_sensors();
+
+		// Overflows of the JSON rendered for the web server
+		report_json_overflow();
+
 		if ( data_push_timer && (( millis() - data_push_millis ) > 1000 * data_push_timer )) {
 
 			send_data();
 			data_push_millis = millis();
+#if WAKE_TRACING
+			// Never sleeping on mains power: each data push closes a wake
+			WakeTracer::end_of_wake( debug_mode );
+#endif
 		}
 
 		delay( 500 );
@@ -625,6 +851,9 @@ void EcoStation::periodic_tasks( void *dummy )	// NOSONAR
 void EcoStation::prepare_for_deep_sleep( int deep_sleep_secs )
 {
 	network.prepare_for_deep_sleep( deep_sleep_secs );
+#if WAKE_TRACING
+	WakeTracer::end_of_wake( debug_mode );
+#endif
 }
 
 template void EcoStation::print_config_string<>( const char *fmt );
@@ -650,7 +879,7 @@ void EcoStation::print_config_string( const char *fmt, Args... args )
 void EcoStation::print_runtime_config( void )
 {
 	std::array<char, 116>	string;
-	const char			*root_ca = config.get_root_ca().data();
+	const char			*root_ca = config.get_loaded_root_ca().data();
 	int					ca_pos = 0;
 
 	if ( config.get_has_device( aws_device_t::LORAWAN_DEVICE ) ) {
@@ -674,11 +903,15 @@ void EcoStation::print_runtime_config( void )
 	print_config_string( "# URL PATH       : /%s", config.get_parameter<const char *>( "url_path" ));
 	print_config_string( "# TZNAME         : %s", config.get_parameter<const char *>( "tzname" ));
 
+	// Only shown once a connection has read it, the banner must not mount the filesystem on snapshot wakes
+	int ca_len = config.get_loaded_root_ca().size();
+
+	if ( !ca_len )
+		print_config_string( "# ROOT CA        : <not loaded yet>" );
+
 	memset( string.data(), 0, string.size() );
 	int str_len = snprintf( string.data(), string.size() - 1, "[STATION   ] [INFO ] # ROOT CA        : " );
 
-	int ca_len = config.get_root_ca().size();
-
 	while ( ca_pos < ca_len ) {
 
 		ca_pos = reformat_ca_root_line( string, str_len, ca_pos, ca_len, root_ca );
@@ -697,36 +930,68 @@ void EcoStation::print_runtime_config( void )
 	print_config_string( "# SPL              : %s", config.get_has_device( aws_device_t::SPL_SENSOR ) ? "Yes" : "No" );
 }
 
+//
+// Calibrated (eFuse Vref / two point) conversions in a burst, sorted so that the ADC_TRIM lowest and highest
+// values, the usual ESP32 ADC spikes, are left out of the average.
+//
+uint32_t EcoStation::read_adc_millivolts( uint8_t pin )
+{
+	std::array<uint16_t, ADC_SAMPLES>	samples;
+	uint32_t							sum = 0;
+
+	for ( auto &s : samples )
+		s = analogReadMilliVolts( pin );
+
+	std::sort( samples.begin(), samples.end() );
+	for ( uint8_t i = ADC_TRIM; i < ADC_SAMPLES - ADC_TRIM; i++ )
+		sum += samples[ i ];
+
+	return sum / ( ADC_SAMPLES - 2 * ADC_TRIM );
+}
+
 void EcoStation::read_battery_level( void )
 {
 	if ( !solar_panel )
 		return;
 
-	int	adc_value = 0;
+	WAKE_TRACE( wake_phase_t::BATTERY );
 
+	uint32_t	adc_mv;
+	uint32_t	panel_adc_mv;
+
+	// Both ADC inputs are on ADC2 which cannot be used while WiFi is on
 	WiFi.mode ( WIFI_OFF );
 
 	digitalWrite( GPIO_BAT_ADC_EN, HIGH );
+	delay( ADC_SETTLE_MS );
+	adc_mv = read_adc_millivolts( GPIO_BAT_ADC );
+	digitalWrite( GPIO_BAT_ADC_EN, LOW );
 
-	for ( uint8_t i = 0; i < 5; i++ ) {
+	panel_adc_mv = read_adc_millivolts( GPIO_PANEL_ADC );
 
-		delay( 500 );
-		adc_value += analogRead( GPIO_BAT_ADC );
-	}
+	station_data.health.battery_mv = adc_mv * ( V_DIV_R1 + V_DIV_R2 ) / V_DIV_R2;
+	station_data.health.panel_mv = static_cast<uint16_t>( static_cast<float>( panel_adc_mv ) * config.get_compiled_config().panel_divider );
+	station_data.health.battery_level = ( station_data.health.battery_mv > BAT_V_MIN ) ? 100.F * ( std::min( station_data.health.battery_mv, BAT_V_MAX ) - BAT_V_MIN ) / ( BAT_V_MAX - BAT_V_MIN ) : 0;
+	station_data_generation++;
 
-	digitalWrite( GPIO_BAT_ADC_EN, LOW );
+	if ( debug_mode )
+		Serial.printf( "[STATION   ] [DEBUG] Battery level: %03.2f%% (ADC voltage=%1.3fV, battery voltage=%1.3fV), panel voltage=%1.3fV (ADC voltage=%1.3fV)\n", station_data.health.battery_level, adc_mv / 1000.F, station_data.health.battery_mv / 1000.F, station_data.health.panel_mv / 1000.F, panel_adc_mv / 1000.F );
+}
 
-	adc_value /= 5;
-	station_data.health.battery_level = ( adc_value >= ADC_V_MIN ) ? map( adc_value, ADC_V_MIN, ADC_V_MAX, 0, 100 ) : 0;
-	compact_data.battery_level = sensor_manager.float_to_int16_encode( station_data.health.battery_level, 0, 100 );
+// Copies the part of the held JSON starting at index, returns the number of bytes copied
+size_t EcoStation::read_json_sensor_data( uint8_t *buffer, size_t max_len, size_t index )
+{
+	size_t len = 0;
 
-	if ( debug_mode ) {
+	xSemaphoreTake( json_mutex, portMAX_DELAY );
+	if ( index < json_sensor_data_len ) {
 
-		Serial.print( "[STATION   ] [DEBUG] Battery level: " );
-		float adc_v_in = adc_value * VCC / ADC_V_MAX;
-		float bat_v = adc_v_in * ( V_DIV_R1 + V_DIV_R2 ) / V_DIV_R2;
-		Serial.printf( "%03.2f%% (ADC value=%d, ADC voltage=%1.3fV, battery voltage=%1.3fV)\n", station_data.health.battery_level, adc_value, adc_v_in / 1000.F, bat_v / 1000.F );
+		len = std::min( max_len, json_sensor_data_len - index );
+		memcpy( buffer, json_sensor_data.data() + index, len );
 	}
+	xSemaphoreGive( json_mutex );
+
+	return len;
 }
 
 void EcoStation::read_sensors( void )
@@ -776,33 +1041,101 @@ int EcoStation::reformat_ca_root_line( std::array<char, 116> &string, int str_le
 	return ca_pos;
 }
 
+void EcoStation::release_json_sensor_data( void )
+{
+	xSemaphoreTake( json_mutex, portMAX_DELAY );
+	if ( json_sensor_readers )
+		json_sensor_readers--;
+	xSemaphoreGive( json_mutex );
+}
+
+//
+// json_sensor_data is kept until the sensor readings or the station data change, so that HTTP polls between two
+// sensor reads do not render it again. It is not rendered again either while HTTP responses are reading it, these
+// polls get the previous readings with the matching ETag. Callers must hold json_mutex.
+//
+etl::string_view EcoStation::render_json_sensor_data( void )
+{
+	if ( json_sensor_data_valid && ( json_sensor_readers || (( json_sensor_generation == sensor_manager.get_data_generation() ) && ( json_station_generation == station_data_generation ))))
+		return etl::string_view( json_sensor_data );
+
+	json_station_generation = station_data_generation;
+	json_sensor_generation = sensor_manager.get_sensor_snapshot( sensor_snapshot );
+	json_sensor_data_len = write_json_sensor_data( json_sensor_data.data(), json_sensor_data.capacity() + 1, sensor_snapshot );
+	json_sensor_data.uninitialized_resize( json_sensor_data_len );
+	json_sensor_data_valid = ( json_sensor_data_len != 0 );
+
+	return etl::string_view( json_sensor_data );
+}
+
+// Fields that do not change until the next reboot are rendered only once
+void EcoStation::render_json_static_fields( void )
+{
+	JsonBufferWriter json( json_static_fields.data(), json_static_fields.size() );
+
+	json.add( "ota_board", ota_setup.board.data() );
+	json.add( "ota_device", ota_setup.device.data() );
+	json.add( "ota_config", ota_setup.config.data() );
+	json.add( "build_id", ota_setup.version.data() );
+
+	json_static_fields_len = json.size();
+	if ( json.overflowed() )
+		Serial.printf( "[STATION   ] [BUG  ] Static JSON fields do not fit in %d bytes. Please report to support!\n", json_static_fields.size() );
+}
+
+// Only the configured sensors are reported, the other devices (RTC, SD card, LoRaWAN) have their own messages
+//
+// The alarm is a network POST that can take seconds: it is never sent with json_mutex held, which the web server
+// waits for.
+//
+void EcoStation::report_json_overflow( void )
+{
+	etl::string<64>	tmp;
+	size_t			size;
+
+	xSemaphoreTake( json_mutex, portMAX_DELAY );
+	size = json_overflow_size;
+	json_overflow_size = 0;
+	xSemaphoreGive( json_mutex );
+
+	if ( !size )
+		return;
+
+	snprintf( tmp.data(), tmp.capacity(), "sensor_data json is too small ( > %d )", size - 1 );
+	send_alarm( "[STATION] BUG", tmp.data() );
+}
+
 void EcoStation::report_unavailable_sensors( void )
 {
-	std::array<std::string, 7>	sensor_name			= { "MLX96014 ", "TSL2591 ", "BME280 ", "DB_METER" };
-	std::array<char, 96>			unavailable_sensors;
-	aws_device_t				j					= sensor_manager.get_available_sensors();
-	unsigned long				k;
+	const std::array<aws_device_t, 4>	sensors				= { aws_device_t::MLX_SENSOR, aws_device_t::TSL_SENSOR, aws_device_t::BME_SENSOR, aws_device_t::SPL_SENSOR };
+	const std::array<const char *, 4>	sensor_name			= { "MLX90614 ", "TSL2591 ", "BME280 ", "DB_METER " };
+	std::array<char, 96>				unavailable_sensors;
+	bool								all_available		= true;
 
 	strlcpy( unavailable_sensors.data(), "Unavailable sensors: ", unavailable_sensors.size() );
 
-	k = static_cast<unsigned long>( j );
-	for ( uint8_t i = 0; i < 7; i++ ) {
+	for ( uint8_t i = 0; i < sensors.size(); i++ ) {
 
-		if ( ( k & aws_device_t::MLX_SENSOR ) == aws_device_t::NO_SENSOR )		// Flaky, MLX_SENSOR = 1, maybe need to rework this ....
-			strlcat( unavailable_sensors.data(), sensor_name[i].c_str(), 13 );
-		k >>= 1;
-	}
+		if ( !config.get_has_device( sensors[ i ] ) || sensor_manager.sensor_is_available( sensors[ i ] ))
+			continue;
 
-	if ( debug_mode ) {
+		strlcat( unavailable_sensors.data(), sensor_name[ i ], unavailable_sensors.size() );
+		all_available = false;
+	}
 
-		Serial.printf( "[STATION   ] [DEBUG] %s", unavailable_sensors.data() );
+	if ( debug_mode )
+		Serial.printf( "[STATION   ] [DEBUG] %s%s\n", unavailable_sensors.data(), all_available ? "none." : "" );
 
-		if ( j == ALL_SENSORS )
-			Serial.printf( "none.\n" );
-	}
+	if ( !all_available ) {
 
-	if ( j != ALL_SENSORS )
 		send_alarm( "[STATION   ] Unavailable sensors report", unavailable_sensors.data() );
+		unavailable_sensors_reported = true;
+
+	} else if ( unavailable_sensors_reported ) {
+
+		send_alarm( "[STATION   ] Unavailable sensors report", "All sensors are available again." );
+		unavailable_sensors_reported = false;
+	}
 }
 
 void EcoStation::send_alarm( const char *subject, const char *message )
@@ -821,38 +1154,132 @@ void EcoStation::send_alarm( const char *subject, const char *message )
 	serializeJson( content, jsonString );
 }
 
-void EcoStation::send_data( void )
+//
+// In solar panel mode, up to lora_batch_size readings are kept in RTC memory and sent as one uplink.
+// The batch is sent earlier if a reading cannot be delta encoded against the first one (a value moved
+// too much or the set of available sensors changed), if it would not fit in the uplink, or if the reading
+// crossed one of the LORA_BATCH_FLUSH_THRESHOLDS or the low battery level.
+//
+void EcoStation::send_compact_data( void )
 {
-	bool lora_data_sent = false;
+	uint8_t	batch_size	= solar_panel ? std::min( config.get_compiled_config().lora_batch_size, LORA_BATCH_MAX_SIZE ) : 1;
+	size_t	len;
 
-	if ( !solar_panel ) {
+	uplink_max_size = network.get_lorawan_max_payload();
+	payload_sections = get_payload_sections();
+	len = encode_compact_data();
 
-		while ( xSemaphoreTake( sensors_read_mutex, 5000 /  portTICK_PERIOD_MS ) != pdTRUE )
+	if ( debug_mode )
+		Serial.printf( "[STATION   ] [DEBUG] Compact sensor data format version: %02x, %d bytes%s%s, uplink limit is %d bytes.\n", COMPACT_DATA_FORMAT_VERSION, len, ( payload_sections & PAYLOAD_SECTION_EXTENDED_HEALTH ) ? " with extended health data" : "", ( payload_sections & PAYLOAD_SECTION_SPECTRUM ) ? " with spectrum" : "", uplink_max_size );
 
-			if ( debug_mode )
-				Serial.printf( "[STATION   ] [DEBUG] Waiting for sensor data update to complete.\n" );
+	if ( !len ) {
 
+		Serial.printf( "[STATION   ] [BUG  ] Compact sensor data does not fit in %d bytes. Please report to support!\n", compact_data.size() );
+		return;
 	}
 
-	get_json_sensor_data();
-	if ( debug_mode )
-		Serial.printf( "[STATION   ] [DEBUG] Sensor data: %s\n", json_sensor_data.data() );
+	if (( batch_size <= 1 ) && !lora_batch.count ) {
 
-	store_unsent_data( etl::string_view( json_sensor_data ));
-	sensor_manager.encode_sensor_data();
+		if ( send_uplink( compact_data.data(), len, 1 ))
+			uplink_count++;
+		return;
+	}
 
-	if ( config.get_has_device( aws_device_t::LORAWAN_DEVICE ) )
-		network.send_raw_data( reinterpret_cast<uint8_t *>( &compact_data ), sizeof( compact_data_t ) );
+	if ( lora_batch_threshold_crossed() ) {
+
+		if ( debug_mode )
+			Serial.printf( "[STATION   ] [DEBUG] Reading crossed a threshold, sending the batch now.\n" );
+
+		add_to_lora_batch( len, true );
+		flush_lora_batch();
+		return;
+	}
+
+	if ( lora_batch.count && !add_to_lora_batch( len )) {
+
+		if ( debug_mode )
+			Serial.printf( "[STATION   ] [DEBUG] Reading cannot join the current batch, sending it now.\n" );
+
+		// Still not sent, this reading waits with the others
+		if ( !flush_lora_batch() ) {
+
+			add_to_lora_batch( len, true );
+			return;
+		}
+		payload_sections = get_payload_sections();
+		len = encode_compact_data();
+	}
+
+	if ( !lora_batch.count )
+		add_to_lora_batch( len );
+
+	if ( lora_batch.count >= batch_size )
+		flush_lora_batch();
+	else if ( debug_mode )
+		Serial.printf( "[STATION   ] [DEBUG] Reading %d/%d kept for the next uplink.\n", lora_batch.count, batch_size );
+}
+
+//
+// Works on its own copy of the readings and of the JSON: neither the acquisition task nor the web server
+// wait for the uplink, which can take seconds.
+//
+void EcoStation::send_data( void )
+{
+	bool has_lorawan	= config.get_has_device( aws_device_t::LORAWAN_DEVICE );
+	bool has_sdcard		= config.get_has_device( aws_device_t::SDCARD_DEVICE );
+
+	// The noise descriptors sent cover the interval since the previous send
+	sensor_manager.close_noise_interval();
+	uplinks_sent = 0;
+
+	// The JSON is only needed for the SD backlog, the HTTP push and the debug output
+	if ( has_sdcard || !has_lorawan || debug_mode ) {
+
+		xSemaphoreTake( json_mutex, portMAX_DELAY );
+		sensor_manager.get_sensor_snapshot( uplink_snapshot );
+		json_uplink_data.uninitialized_resize( write_json_sensor_data( json_uplink_data.data(), json_uplink_data.capacity() + 1, uplink_snapshot ));
+		xSemaphoreGive( json_mutex );
+		report_json_overflow();
+
+		if ( debug_mode )
+			Serial.printf( "[STATION   ] [DEBUG] Sensor data: %s\n", json_uplink_data.data() );
+
+	} else
+
+		sensor_manager.get_sensor_snapshot( uplink_snapshot );
+
+	if ( has_sdcard )
+		store_unsent_data( etl::string_view( json_uplink_data ));
+
+	if ( has_lorawan )
+		send_compact_data();
 	else
-		network.post_content( "newData.php", strlen( "newData.php" ), json_sensor_data.data() );
+		network.post_content( "newData.php", strlen( "newData.php" ), json_uplink_data.data() );
 
 
 	network.empty_queue();
 
 	digitalWrite( GPIO_ENABLE_3_3V, LOW );
+}
 
-	if ( !solar_panel )
-		xSemaphoreGive( sensors_read_mutex );
+bool EcoStation::send_uplink( uint8_t *data, size_t len, uint8_t readings )
+{
+	if ( uplinks_sent >= LORA_MAX_UPLINKS_PER_SEND ) {
+
+		Serial.printf( "[STATION   ] [INFO ] %d uplinks already sent, %d reading(s) wait for the next one.\n", uplinks_sent, readings );
+		return false;
+	}
+
+	if ( debug_mode )
+		Serial.printf( "[STATION   ] [DEBUG] Uplink of %d reading(s) in %d bytes, estimated airtime %dms.\n", readings, len, network.get_lorawan_airtime_ms( len ));
+
+	uplinks_sent++;
+	if ( !network.send_raw_data( data, len )) {
+
+		Serial.printf( "[STATION   ] [ERROR] Uplink of %d bytes was not sent.\n", len );
+		return false;
+	}
+	return true;
 }
 
 void EcoStation::set_LoRaWAN_joined( bool b )
@@ -879,8 +1306,9 @@ void EcoStation::start_ota_task( void )
 
 bool EcoStation::store_unsent_data( etl::string_view data )
 {
-	bool			ok;
-	aws_device_t	devs = compact_data.available_sensors;
+	bool	ok;
+
+	WAKE_TRACE( wake_phase_t::SD_WRITE );
 
 	UNSELECT_SPI_DEVICES();
 
@@ -899,7 +1327,7 @@ bool EcoStation::store_unsent_data( etl::string_view data )
 		return false;
 	}
 
-	if (( ok = ( backlog.printf( "%s\n", data.data()) == ( 1 + json_sensor_data_len )) )) {
+	if (( ok = ( backlog.printf( "%s\n", data.data()) == ( 1 + data.size() )) )) {
 
 		if ( debug_mode )
 			Serial.printf( "[STATION   ] [DEBUG] Data stored: [%s]\n", data.data() );
@@ -909,8 +1337,7 @@ bool EcoStation::store_unsent_data( etl::string_view data )
 	} else {
 
 		Serial.printf( "[STATION   ] [ERROR] Could not store data.\n" );
-		devs &= ~aws_device_t::SDCARD_DEVICE;
-		compact_data.available_sensors = devs;
+		sensor_manager.update_available_sensors( aws_device_t::SDCARD_DEVICE, false );
 	}
 
 	backlog.close();
@@ -926,14 +1353,14 @@ bool EcoStation::sync_time( bool verbose )
 	if ( debug_mode && verbose )
 		Serial.printf( "[STATION   ] [DEBUG] Connecting to NTP server " );
 
-	configTzTime( config.get_parameter<const char *>( "tzname" ), ntp_server );
+	configTzTime( config.get_compiled_config().tzname.data(), ntp_server );
 
 	while ( !( ntp_synced = getLocalTime( &timeinfo )) && ( --ntp_retries > 0 ) ) {	// NOSONAR
 
 		if ( debug_mode && verbose )
 			Serial.printf( "." );
 		delay( 1000 );
-		configTzTime( config.get_parameter<const char *>( "tzname" ), ntp_server );
+		configTzTime( config.get_compiled_config().tzname.data(), ntp_server );
 	}
 	if ( debug_mode && verbose ) {
 
@@ -957,10 +1384,11 @@ bool EcoStation::sync_time( bool verbose )
 
 			// Not proud of this but it should be sufficient if the number of times we miss ntp sync is not too big
 			ntp_time_misses++;
-			sensor_manager.get_sensor_data()->timestamp =  last_ntp_time + ( get_config().get_parameter<uint16_t>( "sleep_minutes" ) * 60 ) * ntp_time_misses;
+			sensor_manager.get_sensor_data()->timestamp =  last_ntp_time + ( config.get_compiled_config().sleep_minutes * 60 ) * ntp_time_misses;
 
 		}
 	}
+	station_data_generation++;
 	return ntp_synced;
 }
 
@@ -970,3 +1398,136 @@ void EcoStation::trigger_ota_update( void )
 	if ( solar_panel )
 		start_ota_task();
 }
+
+//
+// The JSON of a snapshot of the readings is streamed into buffer, without any intermediate document.
+// Returns its length, 0 if it does not fit: then json_overflow_size is set and the caller must call
+// report_json_overflow() once it has released json_mutex. Callers must hold json_mutex.
+//
+size_t EcoStation::write_json_sensor_data( char *buffer, size_t size, const sensor_data_t &snapshot )
+{
+	const payload_schema_t	*schema = payload_get_schema( COMPACT_DATA_FORMAT_VERSION );
+	JsonBufferWriter		json( buffer, size );
+
+	json.begin_object();
+
+	// Fields shared with the compact payload are written from its schema, with their unquantised values and the type of their reading
+	for ( size_t i = 0; i < schema->count; i++ ) {
+
+		const payload_field_desc_t	&desc = schema->fields[ i ];
+
+		if ( desc.field == payload_field_t::SECTIONS )
+			continue;
+
+		double v = get_payload_value( snapshot, desc.field );
+
+		switch ( payload_json_type( desc.field )) {
+
+			case payload_json_t::INTEGER:
+				json.add( desc.name, static_cast<long>( v ));
+				break;
+
+			case payload_json_t::UNSIGNED:
+				json.add( desc.name, static_cast<unsigned long>( v ));
+				break;
+
+			case payload_json_t::REAL:
+				json.add( desc.name, static_cast<float>( v ));
+				break;
+		}
+	}
+
+	json.add_fragment( json_static_fields.data(), json_static_fields_len );
+	json.add( "sl_pressure", snapshot.weather.sl_pressure );
+	json.add( "dew_point", snapshot.weather.dew_point );
+	json.add( "noise_samples", static_cast<unsigned long>( snapshot.noise.samples ));
+	json.add( "integration_time", static_cast<unsigned long>( snapshot.sqm.integration_time ));
+	json.add( "gain", static_cast<unsigned long>( snapshot.sqm.gain ));
+	json.add( "exposure_ms", static_cast<unsigned long>( snapshot.sqm.exposure_ms ));
+	json.add( "ir_luminosity", static_cast<unsigned long>( snapshot.sqm.ir_luminosity ));
+	json.add( "full_luminosity", static_cast<unsigned long>( snapshot.sqm.full_luminosity ));
+	json.add( "ntp_time_sec", static_cast<long>( station_data.ntp_time.tv_sec ));
+	json.add( "ntp_time_usec", static_cast<long>( station_data.ntp_time.tv_usec ));
+	json.add( "battery_mv", static_cast<unsigned long>( station_data.health.battery_mv ));
+	json.add( "panel_mv", static_cast<unsigned long>( station_data.health.panel_mv ));
+	json.add( "init_heap_size", static_cast<unsigned long>( station_data.health.init_heap_size ));
+	json.add( "current_heap_size", static_cast<unsigned long>( station_data.health.current_heap_size ));
+	json.add( "largest_free_heap_block", static_cast<unsigned long>( station_data.health.largest_free_heap_block ));
+	json.add( "ota_code", static_cast<long>( ota_setup.status_code ));
+	json.add( "ota_status_ts", static_cast<long>( ota_setup.status_ts ));
+	json.add( "ota_last_update_ts", static_cast<long>( ota_setup.last_update_ts ));
+
+#if WAKE_TRACING
+	WakeTracer::get_summary( station_data.health.wake_phases );
+	json.begin_object( "wake_phases" );
+	for ( uint8_t i = 0; i < WAKE_PHASE_COUNT; i++ ) {
+
+		if ( !station_data.health.wake_phases[ i ].samples )
+			continue;
+
+		json.begin_array( WakeTracer::get_phase_name( i ));
+		json.add_value( station_data.health.wake_phases[ i ].min_ms );
+		json.add_value( station_data.health.wake_phases[ i ].avg_ms );
+		json.add_value( station_data.health.wake_phases[ i ].max_ms );
+		json.end_array();
+	}
+	json.end_object();
+#endif
+
+	// Achieved acquisition rate of each sensor: [ period, interval, average jitter, max jitter ] in ms, then [ misses, errors, recoveries ]
+	json.begin_object( "acquisition" );
+	for ( uint8_t i = 0; i < SENSOR_JOB_COUNT; i++ ) {
+
+		sensor_job_stats_t stats;
+
+		if ( !sensor_manager.get_sensor_job_stats( i, stats ))
+			continue;
+
+		json.begin_array( sensor_manager.get_sensor_job_name( i ));
+		json.add_value( stats.period_ms );
+		json.add_value( stats.interval_ms );
+		json.add_value( stats.avg_jitter_ms );
+		json.add_value( stats.max_jitter_ms );
+		json.add_value( stats.misses );
+		json.add_value( stats.errors );
+		json.add_value( stats.recoveries );
+		json.end_array();
+	}
+	json.end_object();
+
+	// Bus usage of each device: [ clock in kHz, transactions, errors, average, max, max wait ] durations in µs
+	json.begin_object( "i2c" );
+	for ( uint8_t i = 0; i < i2c_bus.get_device_count(); i++ ) {
+
+		i2c_device_stats_t stats;
+
+		if ( !i2c_bus.get_device_stats( i, stats ))
+			continue;
+
+		json.begin_array( stats.name );
+		json.add_value( stats.clock_hz / 1000 );
+		json.add_value( stats.transactions );
+		json.add_value( stats.errors );
+		json.add_value( stats.avg_us );
+		json.add_value( stats.max_us );
+		json.add_value( stats.max_wait_us );
+		json.end_array();
+	}
+	json.add( "recoveries", static_cast<unsigned long>( i2c_bus.get_recoveries() ));
+	json.end_object();
+
+	json.end_object();
+
+	if ( json.overflowed() ) {
+
+		buffer[0] = 0;
+		json_overflow_size = size;
+		Serial.printf( "[STATION   ] [BUG  ] sensor_data json is too small ( > %d ). Please report to support!\n", size - 1 );
+		return 0;
+	}
+
+	if ( debug_mode )
+		Serial.printf( "[STATION   ] [DEBUG] sensor_data is %d bytes long, max size is %d bytes.\n", json.size(), size - 1 );
+
+	return json.size();
+}
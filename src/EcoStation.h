@@ -33,14 +33,37 @@ const byte LOW_BATTERY_COUNT_MAX = 10;
 const unsigned short 	BAT_V_MAX		= 4200;		// in mV
 const unsigned short	BAT_V_MIN		= 3000;		// in mV
 const byte 				BAT_LEVEL_MIN	= 33;		// in %, corresponds to ~3.4V for a typical Li-ion battery
-const unsigned short	VCC				= 3300;		// in mV
 const unsigned int		V_DIV_R1		= 82000;	// voltage divider R1 in ohms
 const unsigned int		V_DIV_R2		= 300000;	// voltage divider R2 in ohms
-const unsigned short	ADC_MAX			= 4096;		// 12 bits resolution
-const float				V_MAX_IN		= ( BAT_V_MAX*V_DIV_R2 )/( V_DIV_R1+V_DIV_R2 );	// in mV
-const float				V_MIN_IN		= ( BAT_V_MIN*V_DIV_R2 )/( V_DIV_R1+V_DIV_R2 );	// in mV
-const unsigned short	ADC_V_MAX		= ( V_MAX_IN*ADC_MAX / VCC );
-const unsigned short	ADC_V_MIN		= ( V_MIN_IN*ADC_MAX / VCC );
+const uint32_t			ADC_SETTLE_MS	= 10;		// divider settling time once the battery ADC switch is on
+const uint8_t			ADC_SAMPLES		= 16;		// burst of conversions per voltage reading
+const uint8_t			ADC_TRIM		= 4;		// lowest and highest conversions left out of the average
+
+const size_t	COMPACT_DATA_MAX_SIZE			= 64;
+const uint16_t	EXTENDED_HEALTH_UPLINK_PERIOD	= 24;		// Static health data is sent at cold boot and then every N uplinks
+const uint16_t	SPECTRUM_UPLINK_PERIOD			= 6;		// Octave band levels, if the dB meter reads its spectrum, are sent every N uplinks
+const uint8_t	LORA_BATCH_MAX_SIZE				= 8;
+const uint8_t	LORA_MAX_UPLINKS_PER_SEND		= 2;		// A DR0 uplink takes up to 2.5s of airtime, i.e. minutes of the 1% duty cycle; readings left wait for the next send
+
+// A batched reading that moved this much from the first reading of the batch is sent at once
+struct lora_batch_threshold_t {
+
+	payload_field_t	field;
+	float			change;
+};
+
+const lora_batch_threshold_t LORA_BATCH_FLUSH_THRESHOLDS[] = {
+
+	{ payload_field_t::TEMPERATURE,		3 },		// °C
+	{ payload_field_t::PRESSURE,		3 },		// hPa, passing front
+	{ payload_field_t::RH,				15 },		// %
+	{ payload_field_t::CLOUD_COVERAGE,	1 },		// Clear, cloudy, overcast
+	{ payload_field_t::LEQ,				10 },		// dB(A)
+	{ payload_field_t::LMAX,			15 }		// dB(A)
+};
+
+// A single reading always fits in one uplink, whatever the data rate: only batches depend on it
+static_assert( PAYLOAD_MAX_SIZE <= LORAWAN_LMIC_MAX_PAYLOAD, "LMIC_MAX_FRAME_LENGTH is too small for a single reading" );
 
 const uint8_t SLEEP_MINUTES		= 0x01;
 const uint8_t SPL_CONFIG		= 0x02;
@@ -89,6 +112,21 @@ struct ota_setup_t {
 	time_t			last_update_ts	= 0;
 };
 
+struct firmware_sha256_cache_t {
+
+	uint32_t				partition_address;
+	std::array<char,16>		build_id;
+	std::array<uint8_t,32>	sha256;
+};
+
+// Readings kept in RTC memory until they are sent as one LoRaWAN uplink (solar panel mode)
+struct lora_batch_t {
+
+	uint8_t																			count;
+	std::array<size_t, LORA_BATCH_MAX_SIZE>											size;
+	std::array<std::array<uint8_t, COMPACT_DATA_MAX_SIZE>, LORA_BATCH_MAX_SIZE>	frame;
+};
+
 void OTA_callback( int, int );
 
 class EcoStation {
@@ -100,40 +138,72 @@ class EcoStation {
 		AWSRTC						aws_rtc;
 
 		aws_boot_mode_t				boot_mode					= aws_boot_mode_t::NORMAL;
-		compact_data_t				compact_data;
+		uint32_t					build_info;
+		std::array<uint8_t, COMPACT_DATA_MAX_SIZE>	compact_data;
 		AWSConfig					config;
 		bool						debug_mode					= false;
 		bool						force_ota_update			= false;
-		etl::string<1096>			json_sensor_data;
-		size_t						json_sensor_data_len;
+		SemaphoreHandle_t			json_mutex					= nullptr;
+		etl::string<2560>			json_sensor_data;
+		size_t						json_sensor_data_len		= 0;
+		bool						json_sensor_data_valid		= false;
+		size_t						json_overflow_size			= 0;		// Size of the buffer the JSON did not fit in, until reported
+		uint32_t					json_sensor_generation		= 0;
+		uint8_t						json_sensor_readers			= 0;		// HTTP responses still reading json_sensor_data
+		uint32_t					json_station_generation		= 0;
+		std::array<char, 256>		json_static_fields;
+		size_t						json_static_fields_len		= 0;
+		etl::string<2560>			json_uplink_data;
 		etl::string<128>			location;
 		AWSNetwork					network;
 		bool						ntp_synced					= false;
 		AWSOTA						ota;
+		uint8_t						payload_sections			= 0;
 		ota_setup_t					ota_setup;
 		bool						ready						= false;
 		AWSSensorManager 			sensor_manager;
+		sensor_data_t				sensor_snapshot;			// Readings behind json_sensor_data
 		AWSWebServer 				server;
 		bool						solar_panel					= false;
 		station_data_t				station_data;
+		uint32_t					station_data_generation		= 0;
+		std::array<uint8_t, LORAWAN_MAX_PAYLOAD>	uplink_data;
+		uint8_t						uplink_max_size				= LORAWAN_MAX_PAYLOAD;
+		sensor_data_t				uplink_snapshot;			// Readings being sent by send_data()
+		uint8_t						uplinks_sent				= 0;		// By the current send_data()
 
+		bool			add_to_lora_batch( size_t, bool force = false );
 		void 			determine_boot_mode( void );
 		void			display_banner( void );
+		void			drop_from_lora_batch( uint8_t );
+		size_t			encode_compact_data( void );
 		bool			enter_maintenance_mode( void );
 		void			factory_reset( void );
 		bool			fixup_timestamp( void );
+		bool			flush_lora_batch( void );
+		void			get_firmware_sha256( void );
+		uint8_t			get_payload_sections( void );
+		double			get_payload_value( const sensor_data_t &, payload_field_t );
 		template<typename... Args>
 		etl::string<96>	format_helper( const char *, Args... );
+		bool			lora_batch_threshold_crossed( void );
 		void 			ota_task( void *dummy );
 		void			periodic_tasks( void * );
 		bool			post_content( const char *, const char * );
 		template<typename... Args>
 		void			print_config_string( const char *, Args... );
 		void			print_runtime_config( void );
+		uint32_t		read_adc_millivolts( uint8_t );
 		void			read_battery_level( void );
+		etl::string_view	render_json_sensor_data( void );
+		void			render_json_static_fields( void );
+		void			report_json_overflow( void );
 		int				reformat_ca_root_line( std::array<char,116> &, int, int, int, const char * );
+		void			send_compact_data( void );
+		bool			send_uplink( uint8_t *, size_t, uint8_t );
 		void			start_ota_task( void );
 		bool			store_unsent_data( etl::string_view );
+		size_t			write_json_sensor_data( char *, size_t, const sensor_data_t & );
 
 	public:
 
@@ -141,8 +211,9 @@ class EcoStation {
 		bool				activate_sensors( void );
 		void				check_ota_updates( bool );
 		AWSConfig			&get_config( void );
-		etl::string_view	get_json_sensor_data( void );
+		etl::string<24>		get_json_sensor_data_etag( void );
 		uint32_t			get_uptime( void );
+		size_t				hold_json_sensor_data( etl::string<24> & );
 		bool				initialise( void );
 		bool				is_ready( void );
 		void				LoRaWAN_message_sent( void );
@@ -150,7 +221,9 @@ class EcoStation {
 		bool				on_solar_panel();
 		void				prepare_for_deep_sleep( int );
 		void				reboot( void );
+		size_t				read_json_sensor_data( uint8_t *, size_t, size_t );
 		void				read_sensors( void );
+		void				release_json_sensor_data( void );
 		void				report_unavailable_sensors( void );
 		void				send_alarm( const char *, const char * );
 		void				send_data( void );
@@ -21,12 +21,14 @@
 
 #include "gpio_config.h"
 #include "common.h"
+#include "i2c_bus.h"
 #include "EcoStation.h"
 
 const etl::string<12>		REV					= "1.1.2";
 const unsigned long long	US_HIBERNATE		= 1 * 24 * 60 * 60 * 1000000ULL;	// 1 day
 
-EcoStation station;
+I2CBus		i2c_bus;
+EcoStation	station;
 
 void setup()
 {
@@ -48,7 +50,7 @@ void setup()
 		station.read_sensors();
 		station.send_data();
 
-		uint16_t	sleep_minutes = station.get_config().get_parameter<uint16_t>( "sleep_minutes" );
+		uint16_t	sleep_minutes = station.get_config().get_compiled_config().sleep_minutes;
 
 		station.prepare_for_deep_sleep( sleep_minutes * 60 );
 
@@ -21,17 +21,23 @@
 */
 
 #include <Arduino.h>
+#include <Wire.h>
 
 #include "common.h"
 #include "device.h"
+#include "fast_math.h"
+#include "i2c_bus.h"
 #include "SQM.h"
 #include "sensor_manager.h"
 
-void SQM::initialise( Adafruit_TSL2591 *_tsl, sqm_data_t *data, float calibration_offset, bool _debug_mode )
+RTC_DATA_ATTR sqm_warm_start_t	sqm_warm_start;		// NOSONAR
+
+void SQM::initialise( Adafruit_TSL2591 *_tsl, sqm_data_t *data, float calibration_offset, uint32_t _max_exposure_ms, bool _debug_mode )
 {
 	tsl = _tsl;
 	sqm_data = data;
 	msas_calibration_offset = calibration_offset;
+	max_exposure_ms = _max_exposure_ms;
 	debug_mode = _debug_mode;
 }
 
@@ -51,132 +57,130 @@ float SQM::ch0_temperature_factor( float temp )
 {
 	if ( temp < 0 )
 		return 1.F;
-	return 0.9759F + 0.00192947F*pow( temp, 0.783129F );
+	return 0.9759F + 0.00192947F*fast_powf( temp, 0.783129F );
 }
 
 float SQM::ch1_temperature_factor( float temp )
 {
 	if ( temp < 0 )
 		return 1.F;
-	return 1.05118F - 0.0023342F*pow( temp, 0.958056F );
-}
-
-void SQM::change_gain( uint8_t upDown, tsl2591Gain_t *gain_idx )
-{
-	tsl2591Gain_t	g = static_cast<tsl2591Gain_t>( *gain_idx + 16*upDown );
-
-	if ( g < TSL2591_GAIN_LOW )
-		g = TSL2591_GAIN_LOW;
-	else if ( g > TSL2591_GAIN_MAX )
-		g = TSL2591_GAIN_MAX;
-
-	if ( g != *gain_idx ) {
-
-		tsl->setGain( g );
-		*gain_idx = g;
-	}
+	return 1.05118F - 0.0023342F*fast_powf( temp, 0.958056F );
 }
 
-void SQM::change_integration_time( uint8_t upDown, tsl2591IntegrationTime_t *int_time_idx )
+//
+// Same sequence as the driver's getFullLuminosity(), but the bus is released while the sensor integrates: it is only
+// held to start the exposure and to read both channels, so the other sensors can be read during long exposures.
+// Returns false if the bus could not be had or the sensor did not answer.
+//
+bool SQM::get_full_luminosity( uint32_t *both_channels )
 {
-	tsl2591IntegrationTime_t	t = static_cast<tsl2591IntegrationTime_t>( *int_time_idx + 2*upDown );
+	uint8_t	channels[4];
+	bool	ok;
 
-	if ( t < TSL2591_INTEGRATIONTIME_100MS )
-		t = TSL2591_INTEGRATIONTIME_100MS;
-	else if ( t > TSL2591_INTEGRATIONTIME_600MS )
-		t = TSL2591_INTEGRATIONTIME_600MS;
+	if ( !i2c_bus.lock( TSL2591_ADDR, i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS ))
+		return false;
+	tsl->enable();
+	i2c_bus.unlock( TSL2591_ADDR, true );
 
-	if ( t != *int_time_idx ) {
+	delay( sqm_frame_ms( tsl->getTiming() ));
 
-		tsl->setTiming( t );
-		*int_time_idx = t;
-	}
-}
-
-bool SQM::decrease_gain( tsl2591Gain_t *gain_idx )
-{
-	if ( *gain_idx != TSL2591_GAIN_LOW ) {
-
-		if ( debug_mode )
-			Serial.printf( "[SQM       ] [DEBUG] Decreasing gain.\n" );
-		change_gain( DOWN, gain_idx );
+	if ( !i2c_bus.lock( TSL2591_ADDR, i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS ))
 		return false;
 
-	}
-	return true;
-}
+	// CHAN0 must be read before CHAN1
+	Wire.beginTransmission( TSL2591_ADDR );
+	Wire.write( TSL2591_COMMAND_BIT | TSL2591_REGISTER_CHAN0_LOW );
+	if (( ok = (( Wire.endTransmission() == 0 ) && ( Wire.requestFrom( static_cast<uint8_t>( TSL2591_ADDR ), static_cast<uint8_t>( sizeof( channels ))) == sizeof( channels )))))
+		for ( uint8_t &c : channels )
+			c = Wire.read();
 
-bool SQM::decrease_integration_time( tsl2591IntegrationTime_t *int_time_idx )
-{
-	if ( *int_time_idx != TSL2591_INTEGRATIONTIME_100MS ) {
+	tsl->disable();
+	i2c_bus.unlock( TSL2591_ADDR, ok );
 
-		if ( debug_mode )
-			Serial.printf( "[SQM       ] [DEBUG] Decreasing integration time.\n" );
-		change_integration_time( DOWN, int_time_idx );
-		return true;
-	}
-	return false;	
+	if ( ok )
+		*both_channels = ( static_cast<uint32_t>( channels[3] ) << 24 ) | ( static_cast<uint32_t>( channels[2] ) << 16 ) | ( static_cast<uint32_t>( channels[1] ) << 8 ) | channels[0];
+
+	return ok;
 }
 
-bool SQM::get_msas_nelm( float ambient_temp )
+//
+// One auto-ranging step: returns false if the exposure has to be taken again with the new setting. Once converged,
+// lux, MPSAS and NELM all come from the same exposure.
+//
+bool SQM::get_msas_nelm( float ambient_temp, bool allow_long_exposure )
 {
 	uint32_t	both_channels;
-	uint16_t	ir_luminosity;
-	uint16_t	full_luminosity;
-	uint16_t	visible_luminosity;
-	uint8_t		iterations = 1;
+	uint32_t	ir_luminosity;
+	uint32_t	full_luminosity;
+	uint32_t	visible_luminosity;
+	uint16_t	frames = 1;
 
 	tsl2591Gain_t				gain_idx;
 	tsl2591IntegrationTime_t	int_time_idx;
 
-	const std::array<uint16_t,4>	gain_factor			= { 1, 25, 428, 9876 };
-	const std::array<uint16_t,6>	integration_time	= { 100, 200, 300, 400, 500, 600 };
+	const std::array<uint16_t,4>	&gain_factor		= SQM_GAIN_FACTOR;
+	const std::array<uint16_t,6>	&integration_time	= SQM_INTEGRATION_TIME;
 
 	gain_idx = tsl->getGain();
 	int_time_idx = tsl->getTiming();
-	both_channels = tsl->getFullLuminosity();
-	ir_luminosity = static_cast<uint16_t>( both_channels >> 16 );
-	full_luminosity = static_cast<uint16_t>( both_channels & 0xFFFF );
-	ir_luminosity = static_cast<uint16_t>( static_cast<float>(ir_luminosity) * ch1_temperature_factor( ambient_temp ) );
-	full_luminosity = static_cast<uint16_t>( static_cast<float>(full_luminosity) * ch0_temperature_factor( ambient_temp ) );
-	visible_luminosity = full_luminosity - ir_luminosity;
+	if ( !get_full_luminosity( &both_channels )) {
+
+		Serial.printf( "[SQM       ] [ERROR] Could not read the TSL2591.\n" );
+		sqm_data->lux = -1;
+		return true;
+	}
+	ir_luminosity = both_channels >> 16;
+	full_luminosity = both_channels & 0xFFFF;
+
+	bool saturated = sqm_saturated( int_time_idx, full_luminosity, ir_luminosity );
+
+	ir_luminosity = static_cast<uint32_t>( static_cast<float>(ir_luminosity) * ch1_temperature_factor( ambient_temp ) );
+	full_luminosity = static_cast<uint32_t>( static_cast<float>(full_luminosity) * ch0_temperature_factor( ambient_temp ) );
 
 	// On some occasions this can happen, leading to high values of "visible" although it is dark (as the variable is unsigned), giving erroneous msas
 	if ( full_luminosity < ir_luminosity )
 		return false;
 
+	visible_luminosity = full_luminosity - ir_luminosity;
+
 	if ( debug_mode )
 		Serial.printf( "[SQM       ] [DEBUG] gain=0x%02x (%dx) time=0x%02x (%dms)/ temp=%2.2f° / Infrared=%05d Full=%05d Visible=%05d\n", gain_idx, gain_factor[ gain_idx >> 4 ], int_time_idx, integration_time[ int_time_idx ], ambient_temp, ir_luminosity, full_luminosity, visible_luminosity );
 
-	// Auto gain and integration time, increase time before gain to avoid increasing noise if we can help it, decrease gain first for the same reason
-	// Then retry by returning false
-	if ( visible_luminosity < 128 ) {
+	// Auto gain and integration time along the ladder of sqm_ranging.h, then retry by returning false
+	uint8_t	next_gain	= gain_idx;
+	uint8_t	next_time	= int_time_idx;
 
-		if ( increase_integration_time( &int_time_idx ))
-			return false;
+	if ( visible_luminosity < SQM_MIN_VISIBLE ) {
 
-		if ( increase_gain( &gain_idx ))
-			return false;
+		if ( sqm_more_exposure( &next_gain, &next_time )) {
 
-		iterations = read_with_extended_integration_time( ambient_temp, &ir_luminosity, &full_luminosity, &visible_luminosity );
-		if ( full_luminosity < ir_luminosity )
+			set_setting( next_gain, next_time );
 			return false;
+		}
 
-	}
+		if ( allow_long_exposure )
+			frames = read_long_exposure( ambient_temp, &ir_luminosity, &full_luminosity, &visible_luminosity );
 
-	if (( full_luminosity == 0xFFFF ) || ( ir_luminosity == 0xFFFF )) {
+	} else if ( saturated ) {
 
-		if ( decrease_gain( &gain_idx ))
-			return false;
+		if ( sqm_less_exposure( &next_gain, &next_time )) {
 
-		if ( decrease_integration_time( &int_time_idx ))
+			set_setting( next_gain, next_time );
 			return false;
+		}
 
+		// Too bright even at the lowest setting
+		sqm_data->lux = -1;
+		sqm_data->integration_time = integration_time[ int_time_idx ];
+		sqm_data->exposure_ms = integration_time[ int_time_idx ];
+		sqm_data->gain = gain_factor[ gain_idx >> 4 ];
+		return true;
 	}
 
-	// Comes from Adafruit TSL2591 driver
-	float cpl = static_cast<float>( gain_factor[ gain_idx >> 4 ] ) * static_cast<float>( integration_time[ int_time_idx ] ) / 408.F;
-	float lux = ( static_cast<float>(visible_luminosity) * ( 1.F-( static_cast<float>(ir_luminosity)/static_cast<float>(full_luminosity))) ) / cpl;
+	// Comes from Adafruit TSL2591 driver, the counts of all the frames of a long exposure are summed.
+	// Below one visible count, the reading is the detection limit of the exposure.
+	float cpl = static_cast<float>( gain_factor[ gain_idx >> 4 ] ) * static_cast<float>( integration_time[ int_time_idx ] ) * frames / 408.F;
+	float lux = visible_luminosity ? ( static_cast<float>(visible_luminosity) * ( 1.F-( static_cast<float>(ir_luminosity)/static_cast<float>(full_luminosity))) ) / cpl : 1.F / cpl;
 
 	// About the MSAS formula, quoting http://unihedron.com/projects/darksky/magconv.php:
 	// This formula was derived from conversations on the Yahoo-groups darksky-list
@@ -184,71 +188,124 @@ bool SQM::get_msas_nelm( float ambient_temp )
 	// Date range: Fri, 1 Jul 2005 17:36:41 +0900 to Fri, 15 Jul 2005 08:17:52 -0400
 
 	// I added a calibration offset to match readings from my SQM-LE
-	sqm_data->msas = ( log10( lux / 108000.F ) / -0.4F ) + msas_calibration_offset;
+	sqm_data->lux = lux;
+	sqm_data->msas = ( fast_log10f( lux / 108000.F ) / -0.4F ) + msas_calibration_offset;
 	if ( sqm_data->msas < 0 )
 		sqm_data->msas = 0;
-	sqm_data->nelm = 7.93F - 5.F * log10( pow( 10, ( 4.316F - ( sqm_data->msas / 5.F ))) + 1.F );
+	sqm_data->nelm = 7.93F - 5.F * fast_log10f( fast_exp10f( 4.316F - ( sqm_data->msas / 5.F )) + 1.F );
 
 	sqm_data->integration_time = integration_time[ int_time_idx ];
+	sqm_data->exposure_ms = integration_time[ int_time_idx ] * frames;
 	sqm_data->gain = gain_factor[ gain_idx >> 4 ];
 	sqm_data->full_luminosity = full_luminosity;
 	sqm_data->ir_luminosity = ir_luminosity;
+
+	time( &sqm_warm_start.timestamp );
+	sqm_warm_start.gain = gain_idx;
+	sqm_warm_start.integration_time = int_time_idx;
+	sqm_warm_start.full_luminosity = full_luminosity / frames;
+	sqm_warm_start.visible_luminosity = visible_luminosity / frames;
+
 	if ( debug_mode )
-		Serial.printf( "[SQM       ] [DEBUG] GAIN=[0x%02hhx/%ux] TIME=[0x%02hhx/%ums] Iterations=[%d] Visible=[%05d] Infrared=[%05d] MPSAS=[%f] NELM=[%2.2f]\n", gain_idx, gain_factor[ gain_idx >> 4 ], int_time_idx, integration_time[ int_time_idx ], iterations, visible_luminosity, ir_luminosity, sqm_data->msas, sqm_data->nelm );
+		Serial.printf( "[SQM       ] [DEBUG] GAIN=[0x%02hhx/%ux] TIME=[0x%02hhx/%ums] Frames=[%d] Exposure=[%dms] Visible=[%05d] Infrared=[%05d] MPSAS=[%f] NELM=[%2.2f]\n", gain_idx, gain_factor[ gain_idx >> 4 ], int_time_idx, integration_time[ int_time_idx ], frames, sqm_data->exposure_ms, visible_luminosity, ir_luminosity, sqm_data->msas, sqm_data->nelm );
 
 	return true;
 }
 
-bool SQM::increase_gain( tsl2591Gain_t *gain_idx )
+// See sqm_ranging.h
+bool SQM::predict_setting( tsl2591Gain_t *gain_idx, tsl2591IntegrationTime_t *int_time_idx )
 {
-	if ( *gain_idx != TSL2591_GAIN_MAX ) {
+	uint8_t	gain				= *gain_idx;
+	uint8_t	integration_time	= *int_time_idx;
 
-		if ( debug_mode )
-			Serial.printf( "[SQM       ] [DEBUG] Increasing gain.\n" );
-		change_gain( UP, gain_idx );
-		return true;
-	}
-	return false;
+	if ( !sqm_predict_setting( sqm_warm_start, time( nullptr ), &gain, &integration_time ))
+		return false;
+
+	*gain_idx = static_cast<tsl2591Gain_t>( gain );
+	*int_time_idx = static_cast<tsl2591IntegrationTime_t>( integration_time );
+	return true;
 }
 
-bool SQM::increase_integration_time( tsl2591IntegrationTime_t *int_time_idx )
+//
+// Single acquisition for the TSL2591: lux, irradiance and MPSAS are all derived from the converged exposure.
+// Frames are only stacked into a long exposure if allowed, as it can take up to the exposure budget.
+//
+void SQM::read( float ambient_temp, bool allow_long_exposure )
 {
-	if ( *int_time_idx != TSL2591_INTEGRATIONTIME_600MS ) {
+	WAKE_TRACE( wake_phase_t::SQM );
 
-		if ( debug_mode )
-			Serial.printf( "[SQM       ] [DEBUG] Increasing integration time.\n" );
-		change_integration_time( UP, int_time_idx );
-		return true;
-	}
-	return false;
-}
+	tsl2591Gain_t				gain_idx		= TSL2591_GAIN_LOW;
+	tsl2591IntegrationTime_t	int_time_idx	= TSL2591_INTEGRATIONTIME_100MS;
+	bool						warm_start		= predict_setting( &gain_idx, &int_time_idx );
+	uint8_t						exposures		= 1;
+	uint32_t					start			= millis();
 
-void SQM::read( float ambient_temp )
-{
-	tsl->setGain( TSL2591_GAIN_LOW );
-	tsl->setTiming( TSL2591_INTEGRATIONTIME_100MS );
+	set_setting( gain_idx, int_time_idx );
 
-	while ( !get_msas_nelm( ambient_temp ));
+	while ( !get_msas_nelm( ambient_temp, allow_long_exposure ))
+		if ( ++exposures > SQM_MAX_SETTINGS ) {
+
+			Serial.printf( "[SQM       ] [ERROR] Could not find a valid exposure.\n" );
+			sqm_data->lux = -1;
+			return;
+		}
+
+	if ( debug_mode )
+		Serial.printf( "[SQM       ] [DEBUG] %s start at gain=0x%02x time=0x%02x, converged after %d setting(s) in %lums.\n", warm_start ? "Warm" : "Cold", gain_idx, int_time_idx, exposures, millis() - start );
 }
 
-uint8_t SQM::read_with_extended_integration_time( float ambient_temp, uint16_t *cumulated_ir, uint16_t *cumulated_full, uint16_t *cumulated_visible )
+//
+// Long exposure for the darkest skies, at maximum gain and integration time: frames are summed until the
+// shot noise limited SNR of the visible channel reaches SQM_TARGET_SNR, or until the exposure budget is spent.
+// Frames are taken back to back, and the budget counts their actual duration, integration margin included.
+// The counters are 32 bits wide so that they do not wrap however long the exposure. Returns the frame count.
+//
+uint16_t SQM::read_long_exposure( float ambient_temp, uint32_t *cumulated_ir, uint32_t *cumulated_full, uint32_t *cumulated_visible )
 {
-	uint8_t		iterations = 1;
+	uint16_t	frames			= 1;
+	uint32_t	frame_ms		= SQM_INTEGRATION_TIME[ TSL2591_INTEGRATIONTIME_600MS ];
+	uint32_t	frame_wait_ms	= sqm_frame_ms( TSL2591_INTEGRATIONTIME_600MS );
+
+	auto snr_reached = [&]( void ) {
+
+		return sqm_snr_reached( *cumulated_visible, *cumulated_full, *cumulated_ir );
+	};
+
+	while ( !snr_reached() && (( frames + 1 ) * frame_wait_ms <= max_exposure_ms ) && ( frames < SQM_MAX_FRAMES )) {
+
+		uint32_t both_channels;
 
-	while (( *cumulated_visible < 128 ) && ( iterations <= 32 )) {
+		if ( !get_full_luminosity( &both_channels ))
+			break;
 
-		iterations++;
-		uint32_t both_channels = tsl->getFullLuminosity();
-		uint16_t _ir_luminosity = both_channels >> 16;
-		uint16_t _full_luminosity = both_channels & 0xFFFF;
-		_ir_luminosity = static_cast<uint16_t>( static_cast<float>(_ir_luminosity) * ch1_temperature_factor( ambient_temp ));
-		_full_luminosity = static_cast<uint16_t>( static_cast<float>(_full_luminosity) * ch0_temperature_factor( ambient_temp ));
+		frames++;
+		auto _ir_luminosity = static_cast<uint32_t>( static_cast<float>( both_channels >> 16 ) * ch1_temperature_factor( ambient_temp ));
+		auto _full_luminosity = static_cast<uint32_t>( static_cast<float>( both_channels & 0xFFFF ) * ch0_temperature_factor( ambient_temp ));
 		*cumulated_full += _full_luminosity;
 		*cumulated_ir += _ir_luminosity;
-		*cumulated_visible = *cumulated_full - *cumulated_ir;
-
-		delay( 50 );
+		*cumulated_visible = ( *cumulated_full > *cumulated_ir ) ? *cumulated_full - *cumulated_ir : 0;
 	}
 
-	return iterations;
+	if ( debug_mode )
+		Serial.printf( "[SQM       ] [DEBUG] Long exposure: %d frames (%dms), Visible=%d Infrared=%d, target SNR %s.\n", frames, frames * frame_ms, *cumulated_visible, *cumulated_ir, snr_reached() ? "reached" : "not reached" );
+
+	return frames;
+}
+
+// The driver keeps the setting, it is only written to the sensor if it changed
+bool SQM::set_setting( uint8_t gain, uint8_t integration_time )
+{
+	if (( gain == tsl->getGain() ) && ( integration_time == tsl->getTiming() ))
+		return true;
+
+	if ( !i2c_bus.lock( TSL2591_ADDR, i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS ))
+		return false;
+
+	if ( debug_mode )
+		Serial.printf( "[SQM       ] [DEBUG] New setting gain=0x%02x time=0x%02x.\n", gain, integration_time );
+
+	tsl->setGain( static_cast<tsl2591Gain_t>( gain ));
+	tsl->setTiming( static_cast<tsl2591IntegrationTime_t>( integration_time ));
+	i2c_bus.unlock( TSL2591_ADDR, true );
+	return true;
 }
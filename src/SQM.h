@@ -21,37 +21,35 @@
 #ifndef _SQM_H
 #define _SQM_H
 
-#define	DOWN	( -1 )
-#define	UP		( 1 )
-
 #include "Adafruit_TSL2591.h"
+#include "sqm_ranging.h"
+
+static_assert(( SQM_MAX_GAIN == TSL2591_GAIN_MAX ) && ( SQM_MAX_INTEGRATION_TIME == TSL2591_INTEGRATIONTIME_600MS ), "sqm_ranging.h must match the TSL2591 registers" );
 
 class SQM {
 
 	public:
 
 		SQM( void ) = default;
-		void initialise( Adafruit_TSL2591 *, sqm_data_t *, float, bool );
-		void read( float );
+		void initialise( Adafruit_TSL2591 *, sqm_data_t *, float, uint32_t, bool );
+		void read( float, bool );
 		void set_msas_calibration_offset( float );
 		
 	private:
 
 		bool				debug_mode				= false;
+		uint32_t			max_exposure_ms			= 0;
 		float				msas_calibration_offset	= 0.F;
 		sqm_data_t			*sqm_data				= nullptr;
 		Adafruit_TSL2591	*tsl;
 		
 		float ch0_temperature_factor( float );
 		float ch1_temperature_factor( float );
-		void change_gain( uint8_t, tsl2591Gain_t * );
-		void change_integration_time( uint8_t, tsl2591IntegrationTime_t * );
-		bool decrease_gain( tsl2591Gain_t * );
-		bool decrease_integration_time( tsl2591IntegrationTime_t * );
-		bool increase_gain( tsl2591Gain_t * );
-		bool increase_integration_time( tsl2591IntegrationTime_t * );
-		bool get_msas_nelm(  float );
-		uint8_t read_with_extended_integration_time( float, uint16_t *, uint16_t *, uint16_t * );
+		bool get_full_luminosity( uint32_t * );
+		bool get_msas_nelm( float, bool );
+		bool predict_setting( tsl2591Gain_t *, tsl2591IntegrationTime_t * );
+		uint16_t read_long_exposure( float, uint32_t *, uint32_t *, uint32_t * );
+		bool set_setting( uint8_t, uint8_t );
 		
 };
 
@@ -0,0 +1,164 @@
+/*
+  	bme280.cpp
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "bme280.h"
+
+// The compensation formulas are the 32/64 bits integer ones from the BME280 datasheet, section 4.2.3
+
+float bme280::compensate_humidity( int32_t adc_H )
+{
+	int32_t v = t_fine - 76800;
+	int32_t x = ((( adc_H << 14 ) - ( static_cast<int32_t>( _bme280_calib.dig_H4 ) << 20 ) - ( static_cast<int32_t>( _bme280_calib.dig_H5 ) * v )) + 16384 ) >> 15;
+	int32_t y = (((((( v * static_cast<int32_t>( _bme280_calib.dig_H6 )) >> 10 ) * ((( v * static_cast<int32_t>( _bme280_calib.dig_H3 )) >> 11 ) + 32768 )) >> 10 ) + 2097152 ) *
+				static_cast<int32_t>( _bme280_calib.dig_H2 ) + 8192 ) >> 14;
+
+	v = x * y;
+	v -= ((((( v >> 15 ) * ( v >> 15 )) >> 7 ) * static_cast<int32_t>( _bme280_calib.dig_H1 )) >> 4 );
+	v = std::min( std::max( v, static_cast<int32_t>( 0 )), static_cast<int32_t>( 419430400 ));
+
+	return static_cast<float>( v >> 12 ) / 1024.F;
+}
+
+float bme280::compensate_pressure( int32_t adc_P )
+{
+	int64_t var1 = static_cast<int64_t>( t_fine ) - 128000;
+	int64_t var2 = var1 * var1 * static_cast<int64_t>( _bme280_calib.dig_P6 );
+	int64_t p;
+
+	var2 += ( var1 * static_cast<int64_t>( _bme280_calib.dig_P5 )) << 17;
+	var2 += static_cast<int64_t>( _bme280_calib.dig_P4 ) << 35;
+	var1 = (( var1 * var1 * static_cast<int64_t>( _bme280_calib.dig_P3 )) >> 8 ) + (( var1 * static_cast<int64_t>( _bme280_calib.dig_P2 )) << 12 );
+	var1 = ((( static_cast<int64_t>( 1 ) << 47 ) + var1 ) * static_cast<int64_t>( _bme280_calib.dig_P1 )) >> 33;
+
+	if ( !var1 )
+		return 0.F;
+
+	p = 1048576 - adc_P;
+	p = ((( p << 31 ) - var2 ) * 3125 ) / var1;
+	var1 = ( static_cast<int64_t>( _bme280_calib.dig_P9 ) * ( p >> 13 ) * ( p >> 13 )) >> 25;
+	var2 = ( static_cast<int64_t>( _bme280_calib.dig_P8 ) * p ) >> 19;
+	p = (( p + var1 + var2 ) >> 8 ) + ( static_cast<int64_t>( _bme280_calib.dig_P7 ) << 4 );
+
+	return static_cast<float>( p ) / 256.F;
+}
+
+float bme280::compensate_temperature( int32_t adc_T )
+{
+	int32_t var1 = (( adc_T >> 3 ) - ( static_cast<int32_t>( _bme280_calib.dig_T1 ) << 1 )) * static_cast<int32_t>( _bme280_calib.dig_T2 ) >> 11;
+	int32_t var2 = (( adc_T >> 4 ) - static_cast<int32_t>( _bme280_calib.dig_T1 ));
+
+	var2 = ((( var2 * var2 ) >> 12 ) * static_cast<int32_t>( _bme280_calib.dig_T3 )) >> 14;
+	t_fine = var1 + var2 + t_fine_adjust;
+
+	return static_cast<float>(( t_fine * 5 + 128 ) >> 8 ) / 100.F;
+}
+
+void bme280::get_calibration( bme280_calib_data &calibration )
+{
+	calibration = _bme280_calib;
+}
+
+bool bme280::initialise( uint8_t profile )
+{
+	if ( !begin( BME_I2C_ADDR ))
+		return false;
+
+	set_profile( profile );
+	return true;
+}
+
+// Known sensor: no probe, soft reset or calibration read, a missing sensor shows up as failed reads
+bool bme280::initialise( const bme280_calib_data &calibration, uint8_t profile )
+{
+	if ( !i2c_dev )
+		i2c_dev = new Adafruit_I2CDevice( BME_I2C_ADDR, &Wire );
+	if ( !i2c_dev->begin( false ))
+		return false;
+
+	_bme280_calib = calibration;
+	set_profile( profile );
+	return true;
+}
+
+bool bme280::is_converting( void )
+{
+	return converting;
+}
+
+// Humidity reads as 0 with the ultra low power profile
+bool bme280::read( float &temperature, float &pressure, float &rh )
+{
+	std::array<uint8_t, BME_DATA_SIZE>	data;
+	uint8_t								reg		= BME280_REGISTER_PRESSUREDATA;
+
+	converting = false;
+	if ( !i2c_dev || !i2c_dev->write_then_read( &reg, 1, data.data(), data.size() ))
+		return false;
+
+	int32_t adc_P = ( static_cast<int32_t>( data[0] ) << 12 ) | ( static_cast<int32_t>( data[1] ) << 4 ) | ( data[2] >> 4 );
+	int32_t adc_T = ( static_cast<int32_t>( data[3] ) << 12 ) | ( static_cast<int32_t>( data[4] ) << 4 ) | ( data[5] >> 4 );
+	int32_t adc_H = ( static_cast<int32_t>( data[6] ) << 8 ) | data[7];
+
+	// Skipped measurements read as 0x80000
+	if ( adc_T == 0x80000 )
+		return false;
+
+	temperature = compensate_temperature( adc_T );
+	pressure = ( adc_P == 0x80000 ) ? 0.F : compensate_pressure( adc_P );
+	rh = ( !humidity || ( adc_H == 0x8000 )) ? 0.F : compensate_humidity( adc_H );
+	return true;
+}
+
+void bme280::set_profile( uint8_t profile )
+{
+	// Conversion times are the maximum ones from the datasheet, section 9.1
+	switch ( static_cast<bme_profile_t>( profile )) {
+
+		case bme_profile_t::LOW_NOISE:
+			setSampling( MODE_FORCED, SAMPLING_X2, SAMPLING_X16, SAMPLING_X1, FILTER_X4 );
+			conversion_ms = 47;
+			humidity = true;
+			break;
+
+		case bme_profile_t::ULTRA_LOW_POWER:
+			setSampling( MODE_FORCED, SAMPLING_X1, SAMPLING_X1, SAMPLING_NONE, FILTER_OFF );
+			conversion_ms = 7;
+			humidity = false;
+			break;
+
+		default:
+			setSampling( MODE_FORCED, SAMPLING_X1, SAMPLING_X1, SAMPLING_X1, FILTER_OFF );
+			conversion_ms = 10;
+			humidity = true;
+			break;
+	}
+
+	// setSampling() has just triggered a conversion that nobody waits for
+	converting = false;
+}
+
+// Triggers one forced conversion, returns how long it takes
+uint32_t bme280::start( void )
+{
+	write8( BME280_REGISTER_CONTROL, _measReg.get() );
+	converting = true;
+	return conversion_ms;
+}
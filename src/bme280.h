@@ -0,0 +1,64 @@
+/*
+  	bme280.h
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef _bme280_h
+#define _bme280_h
+
+#include <Adafruit_BME280.h>
+
+const uint8_t	BME_I2C_ADDR		= 0x76;
+const uint8_t	BME_DATA_SIZE		= 8;		// Pressure, temperature and humidity registers, 0xF7 to 0xFE
+
+enum struct bme_profile_t : uint8_t {
+
+	WEATHER,			// Bosch "weather monitoring": x1 oversampling, no filter
+	LOW_NOISE,			// More oversampling on pressure and a light IIR filter
+	ULTRA_LOW_POWER,	// Temperature and pressure only
+	MAX_PROFILE
+};
+
+//
+// Forced mode acquisition: the sensor sleeps between readings, start() triggers one conversion and read() gets
+// the three measurements in a single burst, compensated with the calibration data kept by the Adafruit driver.
+//
+class bme280 : public Adafruit_BME280 {
+
+	public:
+
+		void		get_calibration( bme280_calib_data & );
+		bool		initialise( uint8_t );
+		bool		initialise( const bme280_calib_data &, uint8_t );
+		bool		is_converting( void );
+		bool		read( float &, float &, float & );
+		uint32_t	start( void );
+
+	private:
+
+		uint32_t		conversion_ms	= 0;
+		bool			converting		= false;
+		bool			humidity		= true;
+
+		float			compensate_humidity( int32_t );
+		float			compensate_pressure( int32_t );
+		float			compensate_temperature( int32_t );
+		void			set_profile( uint8_t );
+};
+
+#endif
@@ -29,12 +29,12 @@
 #include "lmic.h"
 
 #include "build_id.h"
+#include "payload_schema.h"
+#include "wake_tracer.h"
 
 // Force DEBUG output even if not activated by external button
 const uint8_t DEBUG_MODE = 1;
 
-const uint8_t COMPACT_DATA_FORMAT_VERSION = 0x03;
-
 extern const etl::string<12>	REV;
 extern HardwareSerial			Serial1;	// NOSONAR
 
@@ -71,23 +71,44 @@ extern const aws_device_t ALL_SENSORS;
 struct health_data_t {
 
 	float			battery_level;
+	uint16_t		battery_mv;
+	uint16_t		panel_mv;
 	uint32_t		fs_free_space;
 	uint32_t		uptime;
 	uint32_t		init_heap_size;
 	uint32_t		current_heap_size;
 	uint32_t		largest_free_heap_block;
+#if WAKE_TRACING
+	wake_phase_summary_t	wake_phases;
+#endif
+
+};
+
+const uint8_t NOISE_OCTAVE_BANDS = 7;
+
+// Statistical noise descriptors over the current reporting interval, in dB(A)
+struct noise_data_t {
 
+	float		leq;		// Energetic average
+	uint8_t		l10;		// Level exceeded 10% of the time
+	uint8_t		l50;
+	uint8_t		l90;
+	uint8_t		lmax;
+	uint32_t	samples;
+	std::array<uint8_t, NOISE_OCTAVE_BANDS>	octaves;	// Energetic average of each band over the interval, 0 if not measured
 };
 
 struct sqm_data_t {
 
+	float		lux;				// From the same exposure as msas, -1 if the sensor saturated at its lowest setting
 	float		msas;
 	float		nelm;
 	uint16_t	gain;
 	uint16_t	integration_time;
-	uint16_t	ir_luminosity;
-	uint16_t	vis_luminosity;
-	uint16_t	full_luminosity;
+	uint32_t	exposure_ms;		// Sum of the integration times of the frames behind the reading
+	uint32_t	ir_luminosity;
+	uint32_t	vis_luminosity;
+	uint32_t	full_luminosity;
 
 };
 
@@ -119,6 +140,7 @@ struct sensor_data_t {
 	weather_data_t	weather;
 	sqm_data_t		sqm;
 	uint8_t			db;
+	noise_data_t	noise;
 	aws_device_t	available_sensors;
 
 };
@@ -131,42 +153,6 @@ struct station_data_t {
 	etl::string<64>	firmware_sha56;
 };
 
-struct compact_data_t {
-
-	uint8_t			format_version;		// Because of alignment made by the compiler,
-										// any change in the data may lead to a different byte arrangement
-										// that needs to be taken into account for decoding
-	time_t			timestamp;
-
-	int32_t			lux;
-	int16_t			irradiance;
-
-	int16_t			temperature;
-	int32_t			pressure;
-	int16_t			rh;
-
-	int16_t			ambient_temperature;
-	int16_t			raw_sky_temperature;
-	int16_t			sky_temperature;
-	int16_t			cloud_cover;
-	uint8_t			cloud_coverage;
-
-	int16_t			msas;
-	int16_t			nelm;
-
-	uint8_t			db;
-
-	aws_device_t	available_sensors;
-
-	int16_t			battery_level;
-	uint32_t		uptime;
-	uint32_t		fs_free_space;
-
-	uint32_t		reset_reason;
-	uint32_t		build_info;
-	uint16_t		sleep_minutes;
-} __attribute__ ((packed));
-
 void loop( void );
 void setup( void );
 
@@ -20,6 +20,7 @@
 #include <ESPAsyncWebServer.h>
 #include <FS.h>
 #include <LittleFS.h>
+#include <rom/crc.h>
 
 #include "defaults.h"
 #include "common.h"
@@ -30,7 +31,8 @@
 extern HardwareSerial Serial1;	// NOSONAR
 extern EcoStation station;
 
-RTC_DATA_ATTR char	_can_rollback	= 0;	// NOSONAR
+RTC_DATA_ATTR char				_can_rollback	= 0;	// NOSONAR
+RTC_DATA_ATTR config_snapshot_t	config_snapshot;		// NOSONAR
 
 template <size_t N>
 etl::string<N * 2> AWSConfig::bytes_to_hex_string( const uint8_t* bytes, size_t length, bool reverse ) const
@@ -63,6 +65,48 @@ bool AWSConfig::can_rollback( void )
 	return _can_rollback;
 }
 
+void AWSConfig::compile_config( void )
+{
+	compiled_config.bme_period = json_config[ config_key_name( aws_config_key::bme_period ) ] | DEFAULT_BME_PERIOD;
+	compiled_config.bme_profile = json_config[ config_key_name( aws_config_key::bme_profile ) ] | DEFAULT_BME_PROFILE;
+	compiled_config.cloud_coverage_formula = json_config[ config_key_name( aws_config_key::cloud_coverage_formula ) ] | 0;
+	compiled_config.k[0] = json_config[ config_key_name( aws_config_key::k1 ) ] | DEFAULT_K1;
+	compiled_config.k[1] = json_config[ config_key_name( aws_config_key::k2 ) ] | DEFAULT_K2;
+	compiled_config.k[2] = json_config[ config_key_name( aws_config_key::k3 ) ] | DEFAULT_K3;
+	compiled_config.k[3] = json_config[ config_key_name( aws_config_key::k4 ) ] | DEFAULT_K4;
+	compiled_config.k[4] = json_config[ config_key_name( aws_config_key::k5 ) ] | DEFAULT_K5;
+	compiled_config.k[5] = json_config[ config_key_name( aws_config_key::k6 ) ] | DEFAULT_K6;
+	compiled_config.k[6] = json_config[ config_key_name( aws_config_key::k7 ) ] | DEFAULT_K7;
+	compiled_config.cc_aws_cloudy = json_config[ config_key_name( aws_config_key::cc_aws_cloudy ) ] | DEFAULT_CC_AWS_CLOUDY;
+	compiled_config.cc_aws_overcast = json_config[ config_key_name( aws_config_key::cc_aws_overcast ) ] | DEFAULT_CC_AWS_OVERCAST;
+	compiled_config.cc_aag_cloudy = json_config[ config_key_name( aws_config_key::cc_aag_cloudy ) ] | DEFAULT_CC_AAG_CLOUDY;
+	compiled_config.cc_aag_overcast = json_config[ config_key_name( aws_config_key::cc_aag_overcast ) ] | DEFAULT_CC_AAG_OVERCAST;
+	compiled_config.msas_calibration_offset = json_config[ config_key_name( aws_config_key::msas_calibration_offset ) ] | DEFAULT_MSAS_CORRECTION;
+	compiled_config.lora_batch_size = json_config[ config_key_name( aws_config_key::lora_batch_size ) ] | DEFAULT_LORA_BATCH_SIZE;
+	compiled_config.mlx_period = json_config[ config_key_name( aws_config_key::mlx_period ) ] | DEFAULT_MLX_PERIOD;
+	compiled_config.panel_divider = json_config[ config_key_name( aws_config_key::panel_divider ) ] | DEFAULT_PANEL_DIVIDER;
+	if ( compiled_config.panel_divider < 1.F )		// Not a voltage divider
+		compiled_config.panel_divider = DEFAULT_PANEL_DIVIDER;
+	compiled_config.sleep_minutes = json_config[ config_key_name( aws_config_key::sleep_minutes ) ] | static_cast<uint16_t>( DEFAULT_SLEEP_MINUTES );
+	compiled_config.spl_duration = json_config[ config_key_name( aws_config_key::spl_duration ) ] | DEFAULT_SPL_DURATION;
+	compiled_config.spl_mode = json_config[ config_key_name( aws_config_key::spl_mode ) ] | DEFAULT_SPL_MODE;
+	compiled_config.spl_period = json_config[ config_key_name( aws_config_key::spl_period ) ] | DEFAULT_SPL_PERIOD;
+	compiled_config.spl_spectrum = json_config[ config_key_name( aws_config_key::spl_spectrum ) ] | DEFAULT_SPL_SPECTRUM;
+	compiled_config.sqm_max_exposure = json_config[ config_key_name( aws_config_key::sqm_max_exposure ) ] | DEFAULT_SQM_MAX_EXPOSURE;
+	compiled_config.sqm_period = json_config[ config_key_name( aws_config_key::sqm_period ) ] | DEFAULT_SQM_PERIOD;
+	compiled_config.tsl_period = json_config[ config_key_name( aws_config_key::tsl_period ) ] | DEFAULT_TSL_PERIOD;
+	compiled_config.tzname.assign( json_config[ config_key_name( aws_config_key::tzname ) ] | DEFAULT_TZNAME );
+	compiled_config.wifi_sta_ssid.assign( json_config[ config_key_name( aws_config_key::wifi_sta_ssid ) ] | DEFAULT_WIFI_STA_SSID );
+}
+
+uint32_t AWSConfig::compute_snapshot_crc( const config_snapshot_t &snapshot ) const
+{
+	const auto	*start	= reinterpret_cast<const uint8_t *>( &snapshot ) + offsetof( config_snapshot_t, build_id );
+	size_t		len		= offsetof( config_snapshot_t, config ) - offsetof( config_snapshot_t, build_id ) + snapshot.config_size;
+
+	return crc32_le( 0, start, len );
+}
+
 uint8_t AWSConfig::char2int( char c )
 {
 	if (( c >= '0' ) && ( c <= '9' ))
@@ -134,11 +178,26 @@ aws_pwr_src	AWSConfig::get_pwr_mode( void )
 	return pwr_mode;
 }
 
+// Root CA as it is in memory, empty if it has not been read yet: unlike get_root_ca(), never mounts the filesystem
+etl::string_view AWSConfig::get_loaded_root_ca( void )
+{
+	return etl::string_view( root_ca );
+}
+
 etl::string_view AWSConfig::get_root_ca( void )
 {
+	// Not part of the configuration snapshot, only read when a connection needs it
+	if ( !root_ca.size() && LittleFS.begin( true ))
+		read_root_ca();
+
 	return etl::string_view( root_ca );
 }
 
+const compiled_config_t &AWSConfig::get_compiled_config( void ) const
+{
+	return compiled_config;
+}
+
 bool AWSConfig::get_has_device( aws_device_t dev )
 {
 	return (( devices & dev ) == dev );
@@ -184,6 +243,16 @@ etl::string_view AWSConfig::get_ota_sha256( void )
 	return etl::string_view( ota_sha256 );
 }
 
+void AWSConfig::invalidate_snapshot( void )
+{
+	Preferences nvs;
+
+	config_snapshot.magic = 0;
+	nvs.begin( "config", false );
+	nvs.remove( "snapshot" );
+	nvs.end();
+}
+
 void AWSConfig::list_files( void )
 {
 	File root = LittleFS.open( "/" );
@@ -201,6 +270,14 @@ bool AWSConfig::load( etl::string<64> &firmware_sha256, bool _debug_mode  )
 {
 	debug_mode = _debug_mode;
 
+	if (( esp_reset_reason() == ESP_RST_DEEPSLEEP ) && load_snapshot() ) {
+
+		if ( debug_mode )
+			Serial.printf( "[CONFIGMNGR] [DEBUG] Configuration restored from snapshot.\n" );
+		compile_config();
+		return true;
+	}
+
 	if ( !LittleFS.begin( true )) {
 
 		Serial.printf( "[CONFIGMNGR] [ERROR] Could not access flash filesystem, bailing out!\n" );
@@ -212,7 +289,55 @@ bool AWSConfig::load( etl::string<64> &firmware_sha256, bool _debug_mode  )
 
 	update_fs_free_space();
 
-	return read_config( firmware_sha256 );
+	if ( !read_config( firmware_sha256 ))
+		return false;
+
+	compile_config();
+	save_snapshot();
+	return true;
+}
+
+bool AWSConfig::load_snapshot( void )
+{
+	auto is_valid = [this]( const config_snapshot_t &snapshot ) {
+		return (( snapshot.magic == CONFIG_SNAPSHOT_MAGIC ) && ( snapshot.version == CONFIG_SNAPSHOT_VERSION ) &&
+				( snapshot.config_size <= snapshot.config.size() ) && !strncmp( snapshot.build_id.data(), BUILD_ID, snapshot.build_id.size() ) &&
+				( snapshot.crc32 == compute_snapshot_crc( snapshot )));
+	};
+
+	if ( !is_valid( config_snapshot )) {
+
+		Preferences nvs;
+		nvs.begin( "config", true );
+		bool ok = ( nvs.getBytes( "snapshot", &config_snapshot, sizeof( config_snapshot_t )) == sizeof( config_snapshot_t )) && is_valid( config_snapshot );
+		nvs.end();
+
+		if ( !ok ) {
+
+			Serial.printf( "[CONFIGMNGR] [INFO ] Configuration snapshot is missing or stale.\n" );
+			config_snapshot.magic = 0;
+			return false;
+		}
+	}
+
+	if ( deserializeMsgPack( json_config, config_snapshot.config.data(), config_snapshot.config_size ) != DeserializationError::Ok ) {
+
+		Serial.printf( "[CONFIGMNGR] [ERROR] Could not decode configuration snapshot.\n" );
+		config_snapshot.magic = 0;
+		return false;
+	}
+
+	devices = config_snapshot.devices;
+	pwr_mode = config_snapshot.pwr_mode;
+	fs_free_space = config_snapshot.fs_free_space;
+	lora_appkey = config_snapshot.lora_appkey;
+	lora_eui = config_snapshot.lora_eui;
+	pcb_version.assign( config_snapshot.pcb_version.data() );
+	product.assign( config_snapshot.product.data() );
+	product_version.assign( config_snapshot.product_version.data() );
+	ota_sha256.assign( config_snapshot.ota_sha256.data() );
+
+	return true;
 }
 
 void AWSConfig::migrate_config_and_ui( void )
@@ -264,13 +389,7 @@ bool AWSConfig::read_config( etl::string<64> &firmware_sha256 )
 	devices |= aws_device_t::SPL_SENSOR * ( json_config["has_spl"].is<int>() ? json_config["has_tsl"].as<int>() : DEFAULT_HAS_SPL );
 
 	set_missing_parameters_to_default_values();
-
-	// Add fixed hardware config
-	json_config["has_rtc"] = ( ( devices & aws_device_t::RTC_DEVICE ) == aws_device_t::RTC_DEVICE );
-	json_config["has_lorawan"] = ( ( devices & aws_device_t::LORAWAN_DEVICE ) == aws_device_t::LORAWAN_DEVICE );
-	json_config["has_sdcard"] = ( ( devices & aws_device_t::SDCARD_DEVICE ) == aws_device_t::SDCARD_DEVICE );
-	json_config["lorawan_deveui"] = bytes_to_hex_string<8>( lora_eui.data(), 8, true );
-	json_config["lorawan_appkey"] = bytes_to_hex_string<16>( lora_appkey.data(), 16, false );
+	set_hardware_parameters();
 
 	return true;
 }
@@ -522,10 +641,20 @@ bool AWSConfig::rollback()
 	return true;
 }
 
+//
+// Saving drops the fixed hardware parameters from json_config, they are added back so that the snapshot holds the
+// same keys as a configuration read from the filesystem.
+//
 bool AWSConfig::save_current_configuration( void )
 {
 	JsonVariant v = json_config.as<JsonVariant>();
-	return save_runtime_configuration( v );
+	bool		ok = save_runtime_configuration( v );
+
+	set_hardware_parameters();
+	if ( ok )
+		save_snapshot();
+
+	return ok;
 }
 
 bool AWSConfig::save_runtime_configuration( JsonVariant &_json_config )
@@ -539,6 +668,8 @@ bool AWSConfig::save_runtime_configuration( JsonVariant &_json_config )
 	if ( !verify_entries( _json_config ))
 		return false;
 
+	invalidate_snapshot();
+
 	if ( debug_mode )
 		list_files();
 
@@ -613,6 +744,52 @@ bool AWSConfig::save_runtime_configuration( JsonVariant &_json_config )
 	return true;
 }
 
+void AWSConfig::save_snapshot( void )
+{
+	size_t	config_size = measureMsgPack( json_config );
+
+	if ( config_size > config_snapshot.config.size() ) {
+
+		Serial.printf( "[CONFIGMNGR] [ERROR] Configuration is too big for a snapshot (%d > %d bytes).\n", config_size, config_snapshot.config.size() );
+		invalidate_snapshot();
+		return;
+	}
+
+	config_snapshot.magic = CONFIG_SNAPSHOT_MAGIC;
+	config_snapshot.version = CONFIG_SNAPSHOT_VERSION;
+	config_snapshot.config_size = serializeMsgPack( json_config, config_snapshot.config.data(), config_snapshot.config.size() );
+	strlcpy( config_snapshot.build_id.data(), BUILD_ID, config_snapshot.build_id.size() );
+	config_snapshot.devices = devices;
+	config_snapshot.pwr_mode = pwr_mode;
+	config_snapshot.fs_free_space = fs_free_space;
+	config_snapshot.lora_appkey = lora_appkey;
+	config_snapshot.lora_eui = lora_eui;
+	strlcpy( config_snapshot.pcb_version.data(), pcb_version.data(), config_snapshot.pcb_version.size() );
+	strlcpy( config_snapshot.product.data(), product.data(), config_snapshot.product.size() );
+	strlcpy( config_snapshot.product_version.data(), product_version.data(), config_snapshot.product_version.size() );
+	strlcpy( config_snapshot.ota_sha256.data(), ota_sha256.data(), config_snapshot.ota_sha256.size() );
+	config_snapshot.crc32 = compute_snapshot_crc( config_snapshot );
+
+	Preferences nvs;
+	nvs.begin( "config", false );
+	if ( nvs.putBytes( "snapshot", &config_snapshot, sizeof( config_snapshot_t )) != sizeof( config_snapshot_t ))
+		Serial.printf( "[CONFIGMNGR] [ERROR] Could not save configuration snapshot to NVS.\n" );
+	nvs.end();
+
+	if ( debug_mode )
+		Serial.printf( "[CONFIGMNGR] [DEBUG] Saved configuration snapshot (%d bytes of configuration).\n", config_snapshot.config_size );
+}
+
+// Fixed hardware config, not stored in the configuration file
+void AWSConfig::set_hardware_parameters( void )
+{
+	json_config["has_rtc"] = ( ( devices & aws_device_t::RTC_DEVICE ) == aws_device_t::RTC_DEVICE );
+	json_config["has_lorawan"] = ( ( devices & aws_device_t::LORAWAN_DEVICE ) == aws_device_t::LORAWAN_DEVICE );
+	json_config["has_sdcard"] = ( ( devices & aws_device_t::SDCARD_DEVICE ) == aws_device_t::SDCARD_DEVICE );
+	json_config["lorawan_deveui"] = bytes_to_hex_string<8>( lora_eui.data(), 8, true );
+	json_config["lorawan_appkey"] = bytes_to_hex_string<16>( lora_appkey.data(), 16, false );
+}
+
 void AWSConfig::set_missing_network_parameters_to_default_values( void )
 {
 	if ( !json_config["join_dr"].is<JsonVariant>())
@@ -733,6 +910,36 @@ void AWSConfig::set_missing_parameters_to_default_values( void )
 
 	if ( !json_config["spl_mode"].is<JsonVariant>( ))
 		json_config["spl_mode"] = DEFAULT_SPL_MODE;
+
+	if ( !json_config["spl_spectrum"].is<JsonVariant>( ))
+		json_config["spl_spectrum"] = DEFAULT_SPL_SPECTRUM;
+
+	if ( !json_config["lora_batch_size"].is<JsonVariant>( ))
+		json_config["lora_batch_size"] = DEFAULT_LORA_BATCH_SIZE;
+
+	if ( !json_config["bme_period"].is<JsonVariant>( ))
+		json_config["bme_period"] = DEFAULT_BME_PERIOD;
+
+	if ( !json_config["bme_profile"].is<JsonVariant>( ))
+		json_config["bme_profile"] = DEFAULT_BME_PROFILE;
+
+	if ( !json_config["mlx_period"].is<JsonVariant>( ))
+		json_config["mlx_period"] = DEFAULT_MLX_PERIOD;
+
+	if ( !json_config["panel_divider"].is<JsonVariant>( ))
+		json_config["panel_divider"] = DEFAULT_PANEL_DIVIDER;
+
+	if ( !json_config["spl_period"].is<JsonVariant>( ))
+		json_config["spl_period"] = DEFAULT_SPL_PERIOD;
+
+	if ( !json_config["sqm_max_exposure"].is<JsonVariant>( ))
+		json_config["sqm_max_exposure"] = DEFAULT_SQM_MAX_EXPOSURE;
+
+	if ( !json_config["sqm_period"].is<JsonVariant>( ))
+		json_config["sqm_period"] = DEFAULT_SQM_PERIOD;
+
+	if ( !json_config["tsl_period"].is<JsonVariant>( ))
+		json_config["tsl_period"] = DEFAULT_TSL_PERIOD;
 }
 
 void AWSConfig::set_root_ca( JsonVariant &_json_config )
@@ -802,9 +1009,19 @@ bool AWSConfig::verify_entries( JsonVariant &proposed_config )
 		// General
 		switch( str2int( item.key().c_str() )) {
 
+			case str2int( "bme_period" ):
+			case str2int( "bme_profile" ):
+			case str2int( "lora_batch_size" ):
+			case str2int( "mlx_period" ):
+			case str2int( "panel_divider" ):
 			case str2int( "sleep_minutes" ):
 			case str2int( "spl_duration" ):
 			case str2int( "spl_mode" ):
+			case str2int( "spl_period" ):
+			case str2int( "spl_spectrum" ):
+			case str2int( "sqm_max_exposure" ):
+			case str2int( "sqm_period" ):
+			case str2int( "tsl_period" ):
 				continue;
 
 			default:
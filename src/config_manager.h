@@ -76,6 +76,22 @@ const int				DEFAULT_CC_AAG_CLOUDY					= -20;
 
 const uint8_t			DEFAULT_SPL_MODE						= 0;
 const uint8_t			DEFAULT_SPL_DURATION					= 0;
+const uint8_t			DEFAULT_SPL_SPECTRUM					= 0;		// Spectrum bins read by the dB meter: 0 (none), 16 or 64
+
+const uint8_t			DEFAULT_LORA_BATCH_SIZE					= 1;
+
+const uint8_t			DEFAULT_BME_PROFILE						= 0;		// BME280 sampling profile: 0 (weather station), 1 (low noise), 2 (ultra low power)
+
+const float				DEFAULT_PANEL_DIVIDER					= 2.F;		// Solar panel voltage / ADC voltage, 2 for two equal divider resistors
+
+// Acquisition periods in seconds (DC powered stations, solar panel stations read everything once per wake)
+const uint16_t			DEFAULT_BME_PERIOD						= 60;
+const uint16_t			DEFAULT_MLX_PERIOD						= 30;
+const uint16_t			DEFAULT_SPL_PERIOD						= 5;
+const uint16_t			DEFAULT_SQM_PERIOD						= 300;
+const uint16_t			DEFAULT_TSL_PERIOD						= 60;
+
+const uint16_t			DEFAULT_SQM_MAX_EXPOSURE				= 20;		// in seconds, budget of a long SQM exposure on very dark skies
 
 const aws_wifi_mode		DEFAULT_WIFI_MODE						= aws_wifi_mode::both;
 const aws_ip_mode		DEFAULT_WIFI_STA_IP_MODE				= aws_ip_mode::dhcp;
@@ -85,6 +101,128 @@ const uint16_t			DEFAULT_PUSH_FREQ						= 300;
 const bool				DEFAULT_CHECK_CERTIFICATE				= false;
 const char				DEFAULT_OTA_URL[]						= "https://www.datamancers.net/images/AWS.json";
 
+// Keys of the parameters compiled into compiled_config_t, must match CONFIG_KEY_NAME
+enum struct aws_config_key : uint8_t {
+
+	bme_period,
+	bme_profile,
+	cloud_coverage_formula,
+	k1,
+	k2,
+	k3,
+	k4,
+	k5,
+	k6,
+	k7,
+	cc_aws_cloudy,
+	cc_aws_overcast,
+	cc_aag_cloudy,
+	cc_aag_overcast,
+	msas_calibration_offset,
+	lora_batch_size,
+	mlx_period,
+	panel_divider,
+	sleep_minutes,
+	spl_duration,
+	spl_mode,
+	spl_period,
+	spl_spectrum,
+	sqm_max_exposure,
+	sqm_period,
+	tsl_period,
+	tzname,
+	wifi_sta_ssid
+
+};
+
+constexpr const char *CONFIG_KEY_NAME[] = {
+
+	"bme_period",
+	"bme_profile",
+	"cloud_coverage_formula",
+	"k1",
+	"k2",
+	"k3",
+	"k4",
+	"k5",
+	"k6",
+	"k7",
+	"cc_aws_cloudy",
+	"cc_aws_overcast",
+	"cc_aag_cloudy",
+	"cc_aag_overcast",
+	"msas_calibration_offset",
+	"lora_batch_size",
+	"mlx_period",
+	"panel_divider",
+	"sleep_minutes",
+	"spl_duration",
+	"spl_mode",
+	"spl_period",
+	"spl_spectrum",
+	"sqm_max_exposure",
+	"sqm_period",
+	"tsl_period",
+	"tzname",
+	"wifi_sta_ssid"
+};
+
+constexpr const char *config_key_name( aws_config_key key )
+{
+	return CONFIG_KEY_NAME[ static_cast<uint8_t>( key ) ];
+}
+
+// Typed copy of the parameters read on hot paths, rebuilt whenever json_config changes
+struct compiled_config_t {
+
+	uint16_t			bme_period;
+	uint8_t				bme_profile;
+	int					cloud_coverage_formula;
+	std::array<int,7>	k;
+	int					cc_aws_cloudy;
+	int					cc_aws_overcast;
+	int					cc_aag_cloudy;
+	int					cc_aag_overcast;
+	float				msas_calibration_offset;
+	uint8_t				lora_batch_size;
+	uint16_t			mlx_period;
+	float				panel_divider;
+	uint16_t			sleep_minutes;
+	uint8_t				spl_duration;
+	uint8_t				spl_mode;
+	uint16_t			spl_period;
+	uint8_t				spl_spectrum;
+	uint16_t			sqm_max_exposure;
+	uint16_t			sqm_period;
+	uint16_t			tsl_period;
+	etl::string<64>		tzname;
+	etl::string<32>		wifi_sta_ssid;
+};
+
+const uint32_t			CONFIG_SNAPSHOT_MAGIC					= 0xC0F16A55;
+const uint16_t			CONFIG_SNAPSHOT_VERSION					= 1;
+const size_t			CONFIG_SNAPSHOT_MAX_CONFIG_SIZE			= 1536;
+
+// Effective configuration as restored on deep-sleep wakes, the runtime configuration is kept as MessagePack
+struct config_snapshot_t {
+
+	uint32_t				magic;
+	uint16_t				version;
+	uint16_t				config_size;
+	uint32_t				crc32;
+	std::array<char,16>		build_id;
+	aws_device_t			devices;
+	aws_pwr_src				pwr_mode;
+	uint32_t				fs_free_space;
+	std::array<uint8_t,16>	lora_appkey;
+	std::array<uint8_t,8>	lora_eui;
+	std::array<char,9>		pcb_version;
+	std::array<char,9>		product;
+	std::array<char,9>		product_version;
+	std::array<char,65>		ota_sha256;
+	std::array<uint8_t,CONFIG_SNAPSHOT_MAX_CONFIG_SIZE>	config;
+};
+
 class AWSConfig {
 
 	public:
@@ -95,8 +233,10 @@ class AWSConfig {
 		uint32_t				get_fs_free_space( void );
 		template <typename T>
 		T 						get_parameter( const char * );
+		const compiled_config_t	&get_compiled_config( void ) const;
 		bool					get_has_device( aws_device_t );
 		etl::string_view		get_json_string_config( void );
+		etl::string_view		get_loaded_root_ca( void );
 		std::array<uint8_t,16>	get_lora_appkey( void );
 		etl::string_view		get_lora_appkey_str( void );
 		std::array<uint8_t,8>	get_lora_deveui( void );
@@ -123,6 +263,7 @@ class AWSConfig {
 		aws_device_t			devices					= aws_device_t::NO_SENSOR;
         static const uint32_t	EEPROM_MAGIC			= 0xDEADBEEF;
 		uint32_t				fs_free_space			= 0;
+		compiled_config_t		compiled_config;
 		bool					initialised				= false;
 		JsonDocument			json_config;
 		etl::string<65>			ota_sha256;
@@ -137,15 +278,21 @@ class AWSConfig {
 		template<size_t N>
 		etl::string<N*2>	bytes_to_hex_string( const uint8_t *, size_t, bool  ) const;
 		uint8_t				char2int( char );
+		void				compile_config( void );
+		uint32_t			compute_snapshot_crc( const config_snapshot_t & ) const;
 		template <typename T>
 		T 					get_aag_parameter( const char * );
+		void				invalidate_snapshot( void );
 		void				list_files( void );
+		bool				load_snapshot( void );
 		void				migrate_config_and_ui( void );
 		char				nibble_to_hex_char(uint8_t) const;
 		bool				read_config( etl::string<64> & );
 		bool				read_file( const char * );
 		bool				read_eeprom_and_nvs_config( etl::string<64> & );
 		void				read_root_ca( void );
+		void				save_snapshot( void );
+		void				set_hardware_parameters( void );
 		void				set_missing_network_parameters_to_default_values( void );
 		void				set_missing_parameters_to_default_values( void );
 		void				set_root_ca( JsonVariant & );
@@ -199,17 +346,27 @@ T AWSConfig::get_parameter( const char *key )
 			return ( json_config[key].is<JsonVariant>() ? json_config[key].as<T>() : 0 );	// NOSONAR
 
 		case str2int( "automatic_updates" ):
+		case str2int( "bme_period" ):
+		case str2int( "bme_profile" ):
 		case str2int( "check_certificate" ):
 		case str2int( "data_push" ):
 		case str2int( "join_dr" ):
+		case str2int( "lora_batch_size" ):
+		case str2int( "mlx_period" ):
 		case str2int( "msas_calibration_offset" ):
 		case str2int( "ota_url" ):
+		case str2int( "panel_divider" ):
 		case str2int( "pref_iface" ):
 		case str2int( "push_freq" ):
 		case str2int( "remote_server" ):
 		case str2int( "sleep_minutes" ):
 		case str2int( "spl_duration" ):
 		case str2int( "spl_mode" ):
+		case str2int( "spl_period" ):
+		case str2int( "spl_spectrum" ):
+		case str2int( "sqm_max_exposure" ):
+		case str2int( "sqm_period" ):
+		case str2int( "tsl_period" ):
 		case str2int( "tzname" ):
 		case str2int( "url_path" ):
 		case str2int( "wifi_ap_dns" ):
@@ -242,6 +399,7 @@ void AWSConfig::set_parameter( const char *key, T value )
 		case str2int( "spl_duration" ):
 		case str2int( "spl_mode" ):
 			json_config[key] = value;
+			compile_config();
 			Serial.printf( "[CONFIGMNGR] [INFO ] Set %s=%d\n", key, value );
 			break;
 
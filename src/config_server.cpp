@@ -39,7 +39,6 @@
 
 extern HardwareSerial Serial1;	// NOSONAR
 extern EcoStation station;
-extern SemaphoreHandle_t sensors_read_mutex;	// Issue #7
 
 void AWSWebServer::activate_sensors( AsyncWebServerRequest *request )
 {
@@ -99,12 +98,34 @@ void AWSWebServer::get_station_data( AsyncWebServerRequest *request )
 		return;
 	}
 
-	while ( xSemaphoreTake( sensors_read_mutex, 100 /  portTICK_PERIOD_MS ) != pdTRUE ) { esp_task_wdt_reset(); }
-		if ( debug_mode )
-			Serial.printf( "[WEBSERVER ] [DEBUG] Waiting for sensor data update to complete.\n" );
+	// The JSON changes with the readings and the station data, clients that already have it get a 304
+	etl::string<24> etag = station.get_json_sensor_data_etag();
 
-	request->send( 200, "application/json", station.get_json_sensor_data().data() );
-	xSemaphoreGive( sensors_read_mutex );
+	if ( request->hasHeader( "If-None-Match" ) && ( request->header( "If-None-Match" ) == etag.data() )) {
+
+		AsyncWebServerResponse *response = request->beginResponse( 304 );
+		response->addHeader( "ETag", etag.data() );
+		request->send( response );
+		return;
+	}
+
+	// Served straight from the station's buffer, held until the connection is closed
+	size_t len = station.hold_json_sensor_data( etag );
+
+	if ( !len ) {
+
+		request->send( 500, "text/plain", "[ERROR] Could not render the sensor data, please contact support." );
+		return;
+	}
+
+	request->onDisconnect( []( void ) { station.release_json_sensor_data(); } );
+
+	AsyncWebServerResponse *response = request->beginResponse( "application/json", len, []( uint8_t *buffer, size_t max_len, size_t index ) -> size_t {
+
+		return station.read_json_sensor_data( buffer, max_len, index );
+	});
+	response->addHeader( "ETag", etag.data() );
+	request->send( response );
 }
 
 void AWSWebServer::get_root_ca( AsyncWebServerRequest *request )
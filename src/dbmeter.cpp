@@ -1,26 +1,72 @@
 #include <Arduino.h>
 #include <Wire.h>
+#include "common.h"
 #include "dbmeter.h"
+#include "fast_math.h"
+#include "i2c_bus.h"
 
-bool dbmeter::begin( uint8_t _int_mode, uint8_t seconds )
+RTC_DATA_ATTR dbm_history_window_t	dbm_history_window;		// NOSONAR
+
+// Failed reads and history entries not filled yet read as 0 and are not counted
+void dbmeter::add_sample( uint8_t spl )
 {
-	Wire.begin();
+	if ( !spl || ( histogram[ spl ] == UINT16_MAX ))
+		return;
+
+	histogram[ spl ]++;
+	histogram_samples++;
+}
+
+bool dbmeter::begin( uint8_t _int_mode, uint8_t seconds, uint8_t _spectrum_bins )
+{
+	uint8_t error;
+
+	if ( !i2c_bus.lock( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS ))
+		return false;
+
 	Wire.beginTransmission( static_cast<int>( spl_hw_t::DBM_I2C_ADDR ));
-	if ( Wire.endTransmission() != 0 )
+	error = Wire.endTransmission();
+	i2c_bus.unlock( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), error == 0 );
+	if ( error != 0 )
 		return false;
 	if ( !get_version() )
 		return false;
 	if ( !get_device_id() )
 		return false;
 
+	configure( _int_mode, seconds, _spectrum_bins, false );
+	return true;
+}
+
+// Known meter: the probe and identity reads are skipped, a missing meter shows up as failed level reads
+bool dbmeter::begin( const dbm_identity_t &identity, uint8_t _int_mode, uint8_t seconds, uint8_t _spectrum_bins )
+{
+	version = identity.version;
+	device_id = identity.device_id;
+
+	configure( _int_mode, seconds, _spectrum_bins, true );
+	return true;
+}
+
+//
+// A known meter stayed powered while the station slept: in mode 3 its history already covers the time spent
+// since it was configured, so it is not configured again and the window carries on from RTC memory.
+//
+void dbmeter::configure( uint8_t _int_mode, uint8_t seconds, uint8_t _spectrum_bins, bool known )
+{
+	time_t	now = time( nullptr );
+
+	int_mode = _int_mode;
+	spectrum_bins = (( _spectrum_bins == 16 ) || ( _spectrum_bins == DBM_SPECTRUM_BINS )) ? _spectrum_bins : 0;
 	wait_ms = seconds * 1000;
+	reset_noise_indices();
 
 	switch( int_mode ) {
 
 		case 1:
 			wait_ms += 2000;
-			write_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_TAVGH ), ( wait_ms >> 8 ) & 0x0F );
-			write_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_TAVGL ), wait_ms & 0x0F );
+			write_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_TAVGH ), ( wait_ms >> 8 ) & 0xFF );
+			write_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_TAVGL ), wait_ms & 0xFF );
 			break;
 
 		case 2:
@@ -28,48 +74,247 @@ bool dbmeter::begin( uint8_t _int_mode, uint8_t seconds )
 			write_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_TAVGL ), 125 );
 			break;
 
+		case 3:
+			// Spread the integration time over the history registers, the meter keeps them up to date on its own
+			history_tavg_ms = std::max<uint32_t>( DBM_MIN_TAVG_MS, wait_ms / DBM_HISTORY_SIZE );
+			if ( known && ( dbm_history_window.tavg_ms == history_tavg_ms ) && ( now >= dbm_history_window.read ) && ( dbm_history_window.read >= dbm_history_window.start )) {
+
+				history_start_ms = millis() - std::min<time_t>( now - dbm_history_window.start, seconds ) * 1000;
+				history_read_ms = millis() - std::min<time_t>( now - dbm_history_window.read, seconds ) * 1000;
+				break;
+			}
+			write_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_TAVGH ), ( history_tavg_ms >> 8 ) & 0xFF );
+			write_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_TAVGL ), history_tavg_ms & 0xFF );
+			history_start_ms = millis();
+			history_read_ms = history_start_ms;
+			dbm_history_window = { now, now, history_tavg_ms };
+			break;
+
 		default:
 			break;
 	}
 
-	int_mode = _int_mode;
-	Serial.printf( "[DBMETER   ] [INFO ] DB meter configured in mode %d, integration time=%ds\n", int_mode, seconds );
-	return true;
+	Serial.printf( "[DBMETER   ] [INFO ] DB meter configured in mode %d, integration time=%ds, spectrum bins=%d\n", int_mode, seconds, spectrum_bins );
 }
 
-uint8_t dbmeter::read( void )
+//
+// Integration is split in steps so that the caller does not hold the bus while the meter integrates:
+// start() then poll() until it returns 0, each returning how long to wait before the next call, then collect().
+//
+uint8_t dbmeter::collect( void )
 {
-	float	e = 0;
-	int 	i;
 	uint8_t	spl;
 
+	integrating = false;
+
+	if ( spectrum_bins )
+		read_spectrum();
+
+	if (( int_mode == 2 ) && samples )
+		return static_cast<uint8_t>( power_to_db( energy / samples ));
+
+	if (( int_mode == 3 ) && wait_ms )
+		return read_history();
+
+	add_sample( spl = read_level() );
+	return spl;
+}
+
+//
+// Leq, L10, L50, L90 and Lmax of the samples seen since the last reset, taken from the histogram so that
+// the samples themselves are not kept. L10 is the level exceeded 10% of the time, and so on.
+//
+void dbmeter::get_noise_indices( noise_data_t &noise )
+{
+	double		e		= 0;
+	uint32_t	above	= 0;
+
+	noise = {};
+	noise.samples = histogram_samples;
+	if ( !histogram_samples )
+		return;
+
+	for ( int i = DBM_HISTOGRAM_SIZE - 1; i > 0; i-- ) {
+
+		if ( !histogram[ i ] )
+			continue;
+
+		if ( !above )
+			noise.lmax = i;
+
+		e += histogram[ i ] * db_to_power( i );
+		above += histogram[ i ];
+
+		if ( !noise.l10 && ( above * 10 >= histogram_samples ))
+			noise.l10 = i;
+		if ( !noise.l50 && ( above * 2 >= histogram_samples ))
+			noise.l50 = i;
+		if ( !noise.l90 && ( above * 10 >= histogram_samples * 9 ))
+			noise.l90 = i;
+	}
+	noise.leq = power_to_db( e / histogram_samples );
+
+	for ( uint8_t band = 0; spectrum_reads && ( band < NOISE_OCTAVE_BANDS ); band++ )
+		if ( octave_energy[ band ] > 0 )
+			noise.octaves[ band ] = static_cast<uint8_t>( power_to_db( octave_energy[ band ] / spectrum_reads ));
+}
+
+bool dbmeter::is_integrating( void )
+{
+	return integrating;
+}
+
+uint32_t dbmeter::poll( void )
+{
+	uint32_t	now = millis();
+	uint8_t		spl;
+
+	if ( !integrating )
+		return 0;
+
 	switch( int_mode ) {
 
 		case 0:
 		case 1:
-			if ( wait_ms )
-				delay( wait_ms );
-			read_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_DECIBEL ), 1, &spl );
-			break;
+			if (( now - start_ms ) < wait_ms )
+				return wait_ms - ( now - start_ms );
+			return 0;
+
+		case 3:
+			if (( now - history_start_ms ) < wait_ms )
+				return wait_ms - ( now - history_start_ms );
+			return 0;
 
 		case 2:
-			for( i = 0; i < wait_ms / 500; i++ ) {
+			if ( static_cast<int32_t>( now - next_sample_ms ) < 0 )
+				return next_sample_ms - now;
 
-				delay( 500 );
-				read_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_DECIBEL ), 1, &spl );
-				e += pow( 10, spl/10.0 );
-			}
-			spl = 10*log10(e/i);
-			break;
+			spl = read_level();
+			add_sample( spl );
+			energy += db_to_power( spl );
+			samples++;
+			if (( now - start_ms ) + 500 > wait_ms )
+				return 0;
+			next_sample_ms += 500;
+			return next_sample_ms - now;
 
 		default:
-			read_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_DECIBEL ), 1, &spl );
-			break;
+			return 0;
 	}
+}
+
+//
+// Energetic average of the history entries covering the integration time, fetched in a single transaction.
+// The newest entry comes first; only the entries filled since the previous read are added to the histogram.
+//
+uint8_t dbmeter::read_history( void )
+{
+	std::array<uint8_t, DBM_HISTORY_SIZE>	history		= {};
+	uint8_t									count		= std::min<uint32_t>( DBM_HISTORY_SIZE, std::max<uint32_t>( 1, wait_ms / history_tavg_ms ));
+	uint32_t								fresh		= std::min<uint32_t>( count, ( millis() - history_read_ms ) / history_tavg_ms );
+	float									e			= 0;
+	uint8_t									n			= 0;
+	uint8_t									spl;
+
+	if ( !read_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_DBHISTORY_0 ), count, history.data() )) {
+
+		add_sample( spl = read_level() );
+		return spl;
+	}
+
+	if ( fresh == count )
+		history_read_ms = millis();
+	else
+		history_read_ms += fresh * history_tavg_ms;
+	dbm_history_window.read = time( nullptr ) - ( millis() - history_read_ms ) / 1000;
+
+	// Entries the meter has not filled yet read as 0
+	for ( uint8_t i = 0; i < count; i++ )
+		if ( history[ i ] ) {
+
+			if ( i < fresh )
+				add_sample( history[ i ] );
+			e += db_to_power( history[ i ] );
+			n++;
+		}
+
+	if ( n )
+		return static_cast<uint8_t>( power_to_db( e / n ));
+
+	add_sample( spl = read_level() );
+	return spl;
+}
+
+uint8_t dbmeter::read_level( void )
+{
+	uint8_t	spl = 0;
 
+	read_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_DECIBEL ), 1, &spl );
 	return spl;
 }
 
+void dbmeter::reset_noise_indices( void )
+{
+	histogram.fill( 0 );
+	histogram_samples = 0;
+	octave_energy.fill( 0 );
+	spectrum_reads = 0;
+}
+
+//
+// Bins are linear in frequency, octave band k gathers the 64-bin spectrum bins [ 2^(k-1), 2^k ) (bin 0 for band 0).
+// A 16-bin spectrum cannot tell bands 0 to 2 apart: its first bin goes to band 2 and the lower bands are left out.
+//
+void dbmeter::read_spectrum( void )
+{
+	std::array<uint8_t, DBM_SPECTRUM_BINS>	bins	= {};
+	std::array<float, NOISE_OCTAVE_BANDS>	power	= {};
+	uint8_t									offset	= ( spectrum_bins == DBM_SPECTRUM_BINS ) ? 0 : 2;
+	auto									reg		= ( spectrum_bins == DBM_SPECTRUM_BINS ) ? spl_hw_t::DBM_REG_FREQ_64BINS_0 : spl_hw_t::DBM_REG_FREQ_16BINS_0;
+
+	if ( !read_register( static_cast<uint8_t>( reg ), spectrum_bins, bins.data() ))
+		return;
+
+	for ( uint8_t i = 0; i < spectrum_bins; i++ )
+		power[ offset + ( i ? 32 - __builtin_clz( i ) : 0 ) ] += db_to_power( bins[ i ] );
+
+	for ( uint8_t band = 0; band < NOISE_OCTAVE_BANDS; band++ )
+		octave_energy[ band ] += power[ band ];
+	spectrum_reads++;
+}
+
+uint32_t dbmeter::start( void )
+{
+	integrating = true;
+	start_ms = millis();
+	next_sample_ms = start_ms + 500;
+	energy = 0;
+	samples = 0;
+
+	switch( int_mode ) {
+
+		case 0:
+		case 1:
+			return wait_ms;
+
+		case 2:
+			return ( wait_ms >= 500 ) ? 500 : 0;
+
+		case 3:
+			// Once the history covers the integration time, a reading is a single burst read
+			return poll();
+
+		default:
+			return 0;
+	}
+}
+
+void dbmeter::get_identity( dbm_identity_t &identity )
+{
+	identity.version = version;
+	identity.device_id = device_id;
+}
+
 bool dbmeter::get_version( void )
 {
 	return read_register( static_cast<uint8_t>( spl_hw_t::DBM_REG_VERSION ), 1, &version );
@@ -83,21 +328,35 @@ bool dbmeter::get_device_id( void )
 bool dbmeter::read_register( uint8_t reg, uint8_t sz, uint8_t *buf )
 {
 	uint8_t	i = 0;
+	bool	ok;
+
+	if ( !i2c_bus.lock( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS ))
+		return false;
 
 	Wire.beginTransmission( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ));
 	Wire.write( reg );
-	if ( Wire.endTransmission() != 0 )
-		return false;
-	Wire.requestFrom( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), sz );
-	while( i < sz && Wire.available() )
-		buf[ i++ ] = Wire.read();
-	return true;
+	ok = ( Wire.endTransmission() == 0 );
+	if ( ok ) {
+
+		Wire.requestFrom( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), sz );
+		while( i < sz && Wire.available() )
+			buf[ i++ ] = Wire.read();
+	}
+	i2c_bus.unlock( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), ok );
+	return ok;
 }
 
 bool dbmeter::write_register( uint8_t reg, uint8_t value )
 {
+	bool ok;
+
+	if ( !i2c_bus.lock( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS ))
+		return false;
+
 	Wire.beginTransmission( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ));
 	Wire.write( reg );
 	Wire.write( value );
-	return ( Wire.endTransmission() == 0 );
+	ok = ( Wire.endTransmission() == 0 );
+	i2c_bus.unlock( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), ok );
+	return ok;
 }
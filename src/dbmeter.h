@@ -44,6 +44,11 @@ enum struct spl_hw_t : uint8_t {
 	DBM_REG_FREQ_16BINS_0	= 0xB8,
 	DBM_REG_FREQ_16BINS_15	= 0xC7 };
 
+const uint8_t	DBM_HISTORY_SIZE	= 100;
+const uint16_t	DBM_MIN_TAVG_MS		= 125;
+const uint16_t	DBM_HISTOGRAM_SIZE	= 256;		// One bin per dB
+const uint8_t	DBM_SPECTRUM_BINS	= 64;		// Highest resolution of the spectrum registers, the other one has 16 bins
+
 struct dbm_control_t {
 
 	uint8_t	reserved			: 3;
@@ -53,15 +58,49 @@ struct dbm_control_t {
 	uint8_t	power_down			: 1;
 };
 
+// Read when the meter is first found, kept by the caller so that the next wakes do not probe it again
+struct dbm_identity_t {
+
+	uint8_t					version;
+	std::array<uint8_t,4>	device_id;
+};
+
+// Mode 3 history window, kept in RTC memory: the meter keeps filling its history while the station sleeps
+struct dbm_history_window_t {
+
+	time_t		start;			// When the meter started filling its history with this averaging time
+	time_t		read;			// Last time the history was read, its older entries are already counted
+	uint16_t	tavg_ms;
+};
+
 class dbmeter {
 
 	private:
 
 		std::array<uint8_t,4>	device_id;
+		float					energy;				// Sum of the linear power of the samples taken in mode 2
+		std::array<uint16_t, DBM_HISTOGRAM_SIZE>	histogram;	// Every sample seen since reset_noise_indices()
+		uint32_t				histogram_samples	= 0;
+		uint32_t				history_read_ms;	// Last time the history was read in mode 3, its older entries are already counted
 		bool					i2c_ok;
+		uint16_t				history_tavg_ms;	// Averaging time of each history entry in mode 3
+		uint32_t				history_start_ms;	// When the meter started filling its history in mode 3
 		uint8_t					int_mode;
+		bool					integrating		= false;
+		uint32_t				next_sample_ms;
+		std::array<float, NOISE_OCTAVE_BANDS>	octave_energy;	// Sum of the linear power of each band since reset_noise_indices()
+		uint16_t				samples;
+		uint8_t					spectrum_bins;		// 0 (no spectrum), 16 or 64
+		uint32_t				spectrum_reads		= 0;
+		uint32_t				start_ms;
 		uint8_t					version;
-		uint16_t				wait_ms;
+		uint32_t				wait_ms;
+
+		void		add_sample( uint8_t );
+		void		configure( uint8_t, uint8_t, uint8_t, bool );
+		uint8_t		read_history( void );
+		uint8_t		read_level( void );
+		void		read_spectrum( void );
 
 		bool		get_device_id( void );
 		bool		get_version( void );
@@ -70,8 +109,15 @@ class dbmeter {
 
 	public:
 
-		bool	begin( uint8_t, uint8_t );
-		uint8_t read( void );
+		bool		begin( uint8_t, uint8_t, uint8_t );
+		bool		begin( const dbm_identity_t &, uint8_t, uint8_t, uint8_t );
+		uint8_t		collect( void );
+		void		get_identity( dbm_identity_t & );
+		void		get_noise_indices( noise_data_t & );
+		bool		is_integrating( void );
+		uint32_t	poll( void );
+		void		reset_noise_indices( void );
+		uint32_t	start( void );
 };
 
 #endif
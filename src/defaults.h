@@ -30,8 +30,6 @@ const uint8_t			AT24C_ADDRESS						= 0x50;
 
 const unsigned long		DEFAULT_SLEEP_MINUTES	= 15;
 
-const uint32_t			DEFAULT_SENSOR_POLLING_MS_INTERVAL	= 15000;
-
 static const uint8_t DEFAULT_AUTOMATIC_UPDATES		= 1;
 static const char DEFAULT_SERVER[]				= "www.datamancers.net";
 static const char DEFAULT_WIFI_STA_SSID[]		= "EcoStation";
@@ -0,0 +1,175 @@
+/*
+  	fast_math.h
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//
+// Single precision math kernels for the sensor formulas.
+//
+// The ESP32 FPU only handles floats: the double precision pow/exp/log of the C library are emulated in software.
+// The kernels below work on the float bit pattern and short polynomials; their error is a few 1e-6 (see
+// tools/fast_math_bench.cpp), well under the resolution of any of the sensors. Bounded integer domains (dB levels) use compile time tables.
+// Like payload_schema.h, this header only depends on the C++ standard library so that it can be checked on a host.
+//
+
+#pragma once
+#ifndef _fast_math_H
+#define _fast_math_H
+
+#include <array>
+#include <limits>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const float FAST_LN2		= 0.693147180559945F;
+const float FAST_LOG10_2	= 0.301029995663981F;
+const float FAST_LOG2_E		= 1.442695040888963F;
+const float FAST_LOG2_10	= 3.321928094887362F;
+
+inline float fast_log2f( float x )
+{
+	uint32_t	bits;
+	int32_t		e;
+	float		m;
+
+	if ( !( x > 0 ))
+		return ( x == 0 ) ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::quiet_NaN();
+
+	memcpy( &bits, &x, sizeof( bits ));
+	if (( bits >> 23 ) >= 0xFF )
+		return x;
+
+	// Denormals are scaled up first
+	if ( !( bits >> 23 )) {
+
+		x *= 8388608.F;		// 2^23
+		memcpy( &bits, &x, sizeof( bits ));
+		e = static_cast<int32_t>( bits >> 23 ) - 127 - 23;
+
+	} else
+
+		e = static_cast<int32_t>( bits >> 23 ) - 127;
+
+	bits = ( bits & 0x007FFFFF ) | 0x3F800000;
+	memcpy( &m, &bits, sizeof( m ));
+
+	// m in [ sqrt(2)/2, sqrt(2) [, then log2( m ) = 2/ln2 * atanh( t ) with t = ( m - 1 )/( m + 1 ), |t| < 0.172
+	if ( m > 1.414213562F ) {
+
+		m *= .5F;
+		e++;
+	}
+
+	float t		= ( m - 1.F ) / ( m + 1.F );
+	float t2	= t * t;
+
+	return static_cast<float>( e ) + t * ( 2.885390082F + t2 * ( .961796694F + t2 * ( .577078016F + t2 * .412198583F )));
+}
+
+inline float fast_exp2f( float x )
+{
+	uint32_t	bits;
+	float		scale;
+
+	if ( x != x )
+		return x;
+	if ( x >= 128.F )
+		return std::numeric_limits<float>::infinity();
+	if ( x <= -126.F )
+		return 0.F;
+
+	// 2^x = 2^i * 2^f with i the nearest integer and f in [ -0.5, 0.5 ], 2^f from the series of exp( f * ln2 )
+	auto	i = static_cast<int32_t>( x + ( x >= 0 ? .5F : -.5F ));
+	float	f = ( x - static_cast<float>( i )) * FAST_LN2;
+	float	p = 1.F + f * ( 1.F + f * ( .5F + f * ( .166666667F + f * ( .041666667F + f * ( .008333333F + f * .001388889F )))));
+
+	if ( i > 127 ) {
+
+		p *= 2.F;
+		i--;
+	}
+	bits = static_cast<uint32_t>( i + 127 ) << 23;
+	memcpy( &scale, &bits, sizeof( scale ));
+
+	return p * scale;
+}
+
+inline float fast_log10f( float x )
+{
+	return fast_log2f( x ) * FAST_LOG10_2;
+}
+
+inline float fast_logf( float x )
+{
+	return fast_log2f( x ) * FAST_LN2;
+}
+
+inline float fast_expf( float x )
+{
+	return fast_exp2f( x * FAST_LOG2_E );
+}
+
+inline float fast_exp10f( float x )
+{
+	return fast_exp2f( x * FAST_LOG2_10 );
+}
+
+// Positive bases only, which is all the sensor formulas need
+inline float fast_powf( float base, float exponent )
+{
+	if ( base == 0 )
+		return ( exponent > 0 ) ? 0.F : std::numeric_limits<float>::infinity();
+
+	return fast_exp2f( exponent * fast_log2f( base ));
+}
+
+//
+// Linear power of an integer dB level, 10^( dB / 10 ), for the dB meter (levels, history and spectrum bins are bytes)
+//
+constexpr double DB_TENTH_POWER[] = { 1., 1.2589254117941673, 1.5848931924611136, 1.9952623149688795, 2.5118864315095806,
+									  3.1622776601683795, 3.9810717055349722, 5.0118723362727229, 6.3095734448019325, 7.9432823472428150 };
+
+constexpr double db_to_power_exact( size_t db )
+{
+	return ( db < 10 ) ? DB_TENTH_POWER[ db ] : 10. * db_to_power_exact( db - 10 );
+}
+
+template <size_t... I> struct fast_math_index_list {};
+template <size_t N, size_t... I> struct fast_math_make_index_list : fast_math_make_index_list<N - 1, N - 1, I...> {};
+template <size_t... I> struct fast_math_make_index_list<0, I...> { typedef fast_math_index_list<I...> type; };
+
+template <size_t... I>
+constexpr std::array<float, sizeof...( I )> make_db_power_table( fast_math_index_list<I...> )
+{
+	return {{ static_cast<float>( db_to_power_exact( I ))... }};
+}
+
+constexpr std::array<float, 256> DB_POWER_TABLE = make_db_power_table( fast_math_make_index_list<256>::type() );
+
+inline float db_to_power( uint8_t db )
+{
+	return DB_POWER_TABLE[ db ];
+}
+
+// 10 * log10( power ), back from a sum or average of linear powers
+inline float power_to_db( float power )
+{
+	return 10.F * fast_log10f( power );
+}
+
+#endif
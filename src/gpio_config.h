@@ -38,6 +38,10 @@
 // Solar panel voltage
 #define GPIO_PANEL_ADC			GPIO_NUM_2
 
+// I2C bus
+#define GPIO_I2C_SDA			GPIO_NUM_21
+#define GPIO_I2C_SCL			GPIO_NUM_22
+
 // SD Card reader
 #define	GPIO_SD_MOSI			GPIO_NUM_23	// Module MOSI pin
 #define	GPIO_SD_MISO			GPIO_NUM_19	// Module MISO pin
@@ -0,0 +1,245 @@
+/*
+  	i2c_bus.cpp
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_MLX90614.h>
+#include "Adafruit_TSL2591.h"
+
+#include "defaults.h"
+#include "gpio_config.h"
+#include "common.h"
+#include "AWSRTC.h"
+#include "bme280.h"
+#include "dbmeter.h"
+#include "i2c_bus.h"
+
+I2CBus::I2CBus( void ) :
+	mutex( xSemaphoreCreateRecursiveMutex() )
+{
+	for ( std::atomic<uint8_t> &w : waiting )
+		w.store( 0 );
+}
+
+bool I2CBus::add_device( uint8_t address, const char *name, uint32_t clock )
+{
+	if ( device_count >= I2C_MAX_DEVICES )
+		return false;
+
+	devices[ device_count++ ] = { address, name, clock, 0, 0, 0, 0, 0 };
+	return true;
+}
+
+//
+// Maximum clock of each device: the MLX90614 is an SMBus device and the dB meter is only specified in standard mode,
+// the others support fast mode.
+//
+bool I2CBus::begin( void )
+{
+	device_count = 0;
+	add_device( DS3231_I2C_ADDRESS, "rtc", I2C_FAST_CLOCK );
+	add_device( AT24C_ADDRESS, "eeprom", I2C_FAST_CLOCK );
+	add_device( BME_I2C_ADDR, "bme", I2C_FAST_CLOCK );
+	add_device( MLX90614_I2CADDR, "mlx", I2C_STANDARD_CLOCK );
+	add_device( TSL2591_ADDR, "tsl", I2C_FAST_CLOCK );
+	add_device( static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), "spl", I2C_STANDARD_CLOCK );
+
+	if ( !clear_bus() )
+		Serial.printf( "[I2C       ] [ERROR] SDA is stuck low.\n" );
+
+	clock_hz = I2C_STANDARD_CLOCK;
+	return Wire.begin( GPIO_I2C_SDA, GPIO_I2C_SCL, clock_hz );
+}
+
+//
+// A device that was interrupted in the middle of a read (reset, brown-out) keeps SDA low until it has clocked out
+// its byte: up to 9 clock pulses release it, then a STOP condition resets its state machine.
+//
+bool I2CBus::clear_bus( void )
+{
+	pinMode( GPIO_I2C_SDA, INPUT_PULLUP );
+	pinMode( GPIO_I2C_SCL, OUTPUT_OPEN_DRAIN );
+	digitalWrite( GPIO_I2C_SCL, HIGH );
+	delayMicroseconds( 5 );
+
+	if ( digitalRead( GPIO_I2C_SDA ) == HIGH ) {
+
+		pinMode( GPIO_I2C_SCL, INPUT_PULLUP );
+		return true;
+	}
+
+	for ( uint8_t i = 0; ( i < I2C_RECOVERY_PULSES ) && ( digitalRead( GPIO_I2C_SDA ) == LOW ); i++ ) {
+
+		digitalWrite( GPIO_I2C_SCL, LOW );
+		delayMicroseconds( 5 );
+		digitalWrite( GPIO_I2C_SCL, HIGH );
+		delayMicroseconds( 5 );
+	}
+
+	pinMode( GPIO_I2C_SDA, OUTPUT_OPEN_DRAIN );
+	digitalWrite( GPIO_I2C_SCL, LOW );
+	digitalWrite( GPIO_I2C_SDA, LOW );
+	delayMicroseconds( 5 );
+	digitalWrite( GPIO_I2C_SCL, HIGH );
+	delayMicroseconds( 5 );
+	digitalWrite( GPIO_I2C_SDA, HIGH );
+	delayMicroseconds( 5 );
+
+	pinMode( GPIO_I2C_SDA, INPUT_PULLUP );
+	pinMode( GPIO_I2C_SCL, INPUT_PULLUP );
+	return ( digitalRead( GPIO_I2C_SDA ) == HIGH );
+}
+
+i2c_device_stats_t *I2CBus::find_device( uint8_t address )
+{
+	for ( uint8_t i = 0; i < device_count; i++ )
+		if ( devices[ i ].address == address )
+			return &devices[ i ];
+
+	return nullptr;
+}
+
+uint8_t I2CBus::get_device_count( void )
+{
+	return device_count;
+}
+
+// Returns false if the device has not been used yet
+bool I2CBus::get_device_stats( uint8_t i, i2c_device_stats_t &stats )
+{
+	if (( i >= device_count ) || !devices[ i ].transactions )
+		return false;
+
+	stats = devices[ i ];
+	return true;
+}
+
+uint32_t I2CBus::get_recoveries( void )
+{
+	return recoveries;
+}
+
+bool I2CBus::higher_priority_waiting( i2c_priority_t priority )
+{
+	for ( uint8_t p = static_cast<uint8_t>( priority ) + 1; p < waiting.size(); p++ )
+		if ( waiting[ p ].load() )
+			return true;
+
+	return false;
+}
+
+//
+// The holder of the bus locks again without waiting. Other tasks step aside, one tick at a time, as long as a task
+// of a higher priority is waiting, then queue on the mutex. Unknown devices are run at the standard clock.
+//
+bool I2CBus::lock( uint8_t address, i2c_priority_t priority, uint32_t timeout_ms )
+{
+	uint32_t	wait_start	= micros();
+	TickType_t	ticks		= ( timeout_ms == I2C_NO_TIMEOUT ) ? portMAX_DELAY : pdMS_TO_TICKS( timeout_ms );
+	bool		holder		= ( xSemaphoreGetMutexHolder( mutex ) == xTaskGetCurrentTaskHandle() );
+
+	if ( !holder ) {
+
+		TickType_t start = xTaskGetTickCount();
+
+		waiting[ static_cast<uint8_t>( priority ) ]++;
+		while ( higher_priority_waiting( priority ) && (( xTaskGetTickCount() - start ) < ticks ))
+			vTaskDelay( 1 );
+
+		TickType_t elapsed = xTaskGetTickCount() - start;
+		bool taken = ( elapsed < ticks ) && ( xSemaphoreTakeRecursive( mutex, ( ticks == portMAX_DELAY ) ? portMAX_DELAY : ticks - elapsed ) == pdTRUE );
+
+		waiting[ static_cast<uint8_t>( priority ) ]--;
+		if ( !taken )
+			return false;
+
+	} else
+
+		xSemaphoreTakeRecursive( mutex, 0 );
+
+	if ( address == I2C_NO_DEVICE ) {
+
+		depth++;
+		return true;
+	}
+
+	i2c_device_stats_t *device = find_device( address );
+
+	set_clock( device ? device->clock_hz : I2C_STANDARD_CLOCK );
+
+	if ( !depth++ ) {
+
+		current = device;
+		start_us = micros();
+		if ( current && (( start_us - wait_start ) > current->max_wait_us ))
+			current->max_wait_us = start_us - wait_start;
+	}
+	return true;
+}
+
+// Frees a bus left with SDA low, the holder of the bus only
+bool I2CBus::recover( void )
+{
+	bool ok;
+
+	Wire.end();
+	ok = clear_bus();
+	Wire.begin( GPIO_I2C_SDA, GPIO_I2C_SCL, clock_hz );
+	recoveries++;
+
+	Serial.printf( "[I2C       ] [%s] Bus recovery %s.\n", ok ? "INFO " : "ERROR", ok ? "succeeded" : "failed, SDA is still low" );
+	return ok;
+}
+
+void I2CBus::set_clock( uint32_t clock )
+{
+	if ( clock == clock_hz )
+		return;
+
+	Wire.setClock( clock );
+	clock_hz = clock;
+}
+
+//
+// Only the outermost lock of a device counts as a transaction. After a failed one, the bus is checked and recovered
+// if a device is holding SDA low.
+//
+void I2CBus::unlock( uint8_t address, bool ok )
+{
+	if ( ( depth == 1 ) && ( address != I2C_NO_DEVICE ) && current ) {
+
+		uint32_t elapsed = micros() - start_us;
+
+		current->avg_us = current->transactions ? static_cast<uint32_t>( static_cast<int32_t>( current->avg_us ) + ( static_cast<int32_t>( elapsed ) - static_cast<int32_t>( current->avg_us )) / 8 ) : elapsed;
+		current->max_us = std::max( current->max_us, elapsed );
+		current->transactions++;
+		if ( !ok )
+			current->errors++;
+	}
+
+	if ( !ok && ( address != I2C_NO_DEVICE ) && ( digitalRead( GPIO_I2C_SDA ) == LOW ))
+		recover();
+
+	// A nested lock of another device may have changed the clock
+	if ( !--depth )
+		current = nullptr;
+	else if ( current )
+		set_clock( current->clock_hz );
+	xSemaphoreGiveRecursive( mutex );
+}
@@ -0,0 +1,97 @@
+/*
+  	i2c_bus.h
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef _i2c_bus_H
+#define _i2c_bus_H
+
+#include <Arduino.h>
+#include <array>
+#include <atomic>
+
+const uint32_t	I2C_STANDARD_CLOCK		= 100000;
+const uint32_t	I2C_FAST_CLOCK			= 400000;
+const uint32_t	I2C_LOCK_TIMEOUT_MS		= 1000;
+const uint32_t	I2C_NO_TIMEOUT			= UINT32_MAX;
+const uint8_t	I2C_NO_DEVICE			= 0;		// Serialises with the bus users without any transaction
+const uint8_t	I2C_MAX_DEVICES			= 8;
+const uint8_t	I2C_RECOVERY_PULSES		= 9;
+
+enum struct i2c_priority_t : uint8_t {
+
+	BACKGROUND,		// EEPROM
+	NORMAL,			// Sensors
+	URGENT,			// RTC
+	MAX_PRIORITY
+};
+
+// Bus usage of a device, durations in µs
+struct i2c_device_stats_t {
+
+	uint8_t		address;
+	const char	*name;
+	uint32_t	clock_hz;
+	uint32_t	transactions;
+	uint32_t	errors;
+	uint32_t	avg_us;			// Moving average of the time the bus is held
+	uint32_t	max_us;
+	uint32_t	max_wait_us;	// Longest wait for the bus
+};
+
+//
+// All the drivers go through the bus manager: a transaction (or a group of them) is framed by lock() and unlock().
+// The lock is recursive, so a driver can lock around its own transactions while its caller holds the bus.
+// Waiting tasks of a higher priority get the bus first, the clock is switched to the device's maximum rate,
+// and a bus left with SDA stuck low by an interrupted transaction is cleared before it is used again.
+//
+class I2CBus {
+
+	public:
+
+								I2CBus( void );
+		bool					begin( void );
+		uint8_t					get_device_count( void );
+		bool					get_device_stats( uint8_t, i2c_device_stats_t & );
+		uint32_t				get_recoveries( void );
+		bool					lock( uint8_t, i2c_priority_t, uint32_t );
+		bool					recover( void );
+		void					unlock( uint8_t, bool );
+
+	private:
+
+		SemaphoreHandle_t									mutex			= nullptr;
+		std::array<std::atomic<uint8_t>, static_cast<uint8_t>( i2c_priority_t::MAX_PRIORITY )>	waiting;
+		std::array<i2c_device_stats_t, I2C_MAX_DEVICES>		devices;
+		uint8_t												device_count	= 0;
+		uint32_t											clock_hz		= 0;
+		uint8_t												depth			= 0;		// Nested locks of the holder
+		i2c_device_stats_t									*current		= nullptr;	// Device of the outermost lock
+		uint32_t											start_us		= 0;
+		uint32_t											recoveries		= 0;
+
+		bool					add_device( uint8_t, const char *, uint32_t );
+		bool					clear_bus( void );
+		i2c_device_stats_t		*find_device( uint8_t );
+		bool					higher_priority_waiting( i2c_priority_t );
+		void					set_clock( uint32_t );
+};
+
+extern I2CBus i2c_bus;
+
+#endif
@@ -0,0 +1,227 @@
+/*
+  	json_writer.cpp
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json_writer.h"
+
+JsonBufferWriter::JsonBufferWriter( char *_buffer, size_t _capacity ) : buffer( _buffer ), capacity( _capacity )
+{
+	if ( capacity )
+		buffer[0] = 0;
+	else
+		overflow = true;
+}
+
+void JsonBufferWriter::add( const char *name, bool value )
+{
+	key( name );
+	if ( value )
+		write( "true", 4 );
+	else
+		write( "false", 5 );
+}
+
+void JsonBufferWriter::add( const char *name, float value )
+{
+	key( name );
+	if ( isfinite( value ))
+		write_printf( "%.7g", value );
+	else
+		write( "null", 4 );
+}
+
+void JsonBufferWriter::add( const char *name, long value )
+{
+	key( name );
+	write_printf( "%ld", value );
+}
+
+void JsonBufferWriter::add( const char *name, unsigned long value )
+{
+	key( name );
+	write_printf( "%lu", value );
+}
+
+void JsonBufferWriter::add( const char *name, const char *value )
+{
+	key( name );
+	write_string( value );
+}
+
+// Inserts members rendered beforehand by another writer
+void JsonBufferWriter::add_fragment( const char *fragment, size_t fragment_len )
+{
+	if ( !fragment_len )
+		return;
+
+	separator();
+	write( fragment, fragment_len );
+}
+
+void JsonBufferWriter::add_value( unsigned long value )
+{
+	separator();
+	write_printf( "%lu", value );
+}
+
+void JsonBufferWriter::begin_array( const char *name )
+{
+	key( name );
+	open( '[' );
+}
+
+void JsonBufferWriter::begin_object( void )
+{
+	separator();
+	open( '{' );
+}
+
+void JsonBufferWriter::begin_object( const char *name )
+{
+	key( name );
+	open( '{' );
+}
+
+void JsonBufferWriter::close( char c )
+{
+	if ( depth )
+		depth--;
+	write( c );
+}
+
+void JsonBufferWriter::end_array( void )
+{
+	close( ']' );
+}
+
+void JsonBufferWriter::end_object( void )
+{
+	close( '}' );
+}
+
+void JsonBufferWriter::key( const char *name )
+{
+	separator();
+	write_string( name );
+	write( ':' );
+}
+
+void JsonBufferWriter::open( char c )
+{
+	write( c );
+	if ( depth < 31 )
+		depth++;
+	has_members &= ~( 1UL << depth );
+}
+
+bool JsonBufferWriter::overflowed( void )
+{
+	return overflow;
+}
+
+void JsonBufferWriter::separator( void )
+{
+	if ( has_members & ( 1UL << depth ))
+		write( ',' );
+	has_members |= ( 1UL << depth );
+}
+
+size_t JsonBufferWriter::size( void )
+{
+	return len;
+}
+
+void JsonBufferWriter::write( char c )
+{
+	if ( overflow || ( len + 1 >= capacity )) {
+
+		overflow = true;
+		return;
+	}
+	buffer[ len++ ] = c;
+	buffer[ len ] = 0;
+}
+
+void JsonBufferWriter::write( const char *s, size_t n )
+{
+	if ( overflow || ( len + n >= capacity )) {
+
+		overflow = true;
+		return;
+	}
+	memcpy( buffer + len, s, n );
+	len += n;
+	buffer[ len ] = 0;
+}
+
+void JsonBufferWriter::write_printf( const char *fmt, ... )
+{
+	va_list	args;
+	int		n;
+
+	if ( overflow )
+		return;
+
+	va_start( args, fmt );
+	n = vsnprintf( buffer + len, capacity - len, fmt, args );
+	va_end( args );
+
+	if (( n < 0 ) || ( len + n >= capacity )) {
+
+		overflow = true;
+		buffer[ len ] = 0;
+		return;
+	}
+	len += n;
+}
+
+void JsonBufferWriter::write_string( const char *s )
+{
+	const char	*run = s;
+
+	write( '"' );
+
+	// Copy runs of plain characters in one go, escape the others
+	for ( ; *s; s++ ) {
+
+		auto c = static_cast<unsigned char>( *s );
+
+		if (( c >= 0x20 ) && ( c != '"' ) && ( c != '\\' ))
+			continue;
+
+		write( run, s - run );
+		run = s + 1;
+
+		switch ( c ) {
+
+			case '"':	write( "\\\"", 2 ); break;
+			case '\\':	write( "\\\\", 2 ); break;
+			case '\n':	write( "\\n", 2 ); break;
+			case '\r':	write( "\\r", 2 ); break;
+			case '\t':	write( "\\t", 2 ); break;
+			default:	write_printf( "\\u%04x", c ); break;
+		}
+	}
+	write( run, s - run );
+	write( '"' );
+}
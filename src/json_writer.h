@@ -0,0 +1,72 @@
+/*
+  	json_writer.h
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef _json_writer_H
+#define _json_writer_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Writes JSON straight into a caller supplied buffer, without any intermediate document or heap allocation.
+// The output is always NUL terminated; once the buffer is full, the writer stops and overflowed() returns true.
+// Non finite floats are written as null, as ArduinoJson does.
+//
+class JsonBufferWriter {
+
+	public:
+
+					JsonBufferWriter( char *, size_t );
+
+		void		add( const char *, bool );
+		void		add( const char *, float );
+		void		add( const char *, long );
+		void		add( const char *, unsigned long );
+		void		add( const char *, const char * );
+		void		add_fragment( const char *, size_t );
+		void		add_value( unsigned long );
+		void		begin_array( const char * );
+		void		begin_object( void );
+		void		begin_object( const char * );
+		void		end_array( void );
+		void		end_object( void );
+		bool		overflowed( void );
+		size_t		size( void );
+
+	private:
+
+		char		*buffer;
+		size_t		capacity;
+		size_t		len			= 0;
+		bool		overflow	= false;
+		uint32_t	has_members	= 0;	// One bit per nesting level
+		uint8_t		depth		= 0;
+
+		void		close( char );
+		void		key( const char * );
+		void		open( char );
+		void		separator( void );
+		void		write( char );
+		void		write( const char *, size_t );
+		void		write_printf( const char *, ... );
+		void		write_string( const char * );
+};
+
+#endif
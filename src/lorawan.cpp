@@ -133,10 +133,44 @@ void AWSLoraWAN::empty_queue( void )
 		Serial.printf( "]\n" );
 	}
 
-	LMIC_setTxData2( msg_port, mydata.data(), 8, 0 );
+	if ( LMIC_setTxData2( msg_port, mydata.data(), 8, 0 ) != LMIC_ERROR_SUCCESS ) {
 
-	while( !_message_sent )
-		delay( 100 );
+		Serial.printf( "[LORAWAN   ] [ERROR] LMIC refused the queued message.\n" );
+		return;
+	}
+
+	wait_until_sent();
+}
+
+//
+// LoRa time on air at the current data rate (explicit header, CRC, coding rate 4/5, 8 symbols preamble)
+//
+uint32_t AWSLoraWAN::get_airtime_ms( uint8_t len )
+{
+	uint8_t		dr	= LMIC.datarate;
+	uint16_t	pl	= LORAWAN_FRAME_OVERHEAD + len;
+
+	if ( dr >= EU868_SPREADING_FACTOR.size() )
+		return 0;
+
+	uint8_t		sf	= EU868_SPREADING_FACTOR[ dr ];
+
+	if ( !sf )		// FSK 50kbps: preamble, sync word, length, payload and CRC
+		return (( 5 + 3 + 1 + pl + 2 ) * 8 ) / 50;
+
+	float	t_sym		= static_cast<float>( 1 << sf ) / EU868_BANDWIDTH_KHZ[ dr ];
+	int		ldro		= ( t_sym > 16.F ) ? 1 : 0;
+	int		n_payload	= 8 + std::max( static_cast<int>( ceilf(( 8.F * pl - 4 * sf + 28 + 16 ) / ( 4.F * ( sf - 2 * ldro )))) * 5, 0 );
+
+	return static_cast<uint32_t>(( 12.25F + n_payload ) * t_sym );
+}
+
+// Also bound by the frame buffer LMIC was built with
+uint8_t AWSLoraWAN::get_max_payload( void )
+{
+	uint8_t max_payload = ( LMIC.datarate < EU868_MAX_PAYLOAD.size() ) ? EU868_MAX_PAYLOAD[ LMIC.datarate ] : EU868_MAX_PAYLOAD[0];
+
+	return std::min( max_payload, LORAWAN_LMIC_MAX_PAYLOAD );
 }
 
 bool AWSLoraWAN::join( void )
@@ -275,8 +309,10 @@ void AWSLoraWAN::restore_after_deep_sleep( void )
 	joined = true;
 }
 
-void AWSLoraWAN::send( osjob_t *job )
+bool AWSLoraWAN::send( osjob_t *job )
 {
+	lmic_tx_error_t	error;
+
 	if ( debug_mode ) {
 
 		Serial.printf( "[LORAWAN   ] [DEBUG] Queuing packet of %d bytes [", mylen );
@@ -286,25 +322,29 @@ void AWSLoraWAN::send( osjob_t *job )
 	}
 
 	_message_sent = false;
-	LMIC_setTxData2( 1, mydata.data(), mylen, 0 );
+	if (( error = LMIC_setTxData2( 1, mydata.data(), mylen, 0 )) != LMIC_ERROR_SUCCESS ) {
 
-	while( !_message_sent )
-		delay( 100 );
+		Serial.printf( "[LORAWAN   ] [ERROR] LMIC refused the %d bytes packet (error %d).\n", mylen, error );
+		return false;
+	}
+
+	return wait_until_sent();
 }
 
-void AWSLoraWAN::send_data( uint8_t *buffer, uint8_t len )
+bool AWSLoraWAN::send_data( uint8_t *buffer, uint8_t len )
 {
-	std::fill( mydata.begin(), mydata.end(), 0 );
-	if ( len <= mydata.max_size() ) {
-
-		memcpy( mydata.data(), buffer, len );
-		mylen = len;
+	if ( len > get_max_payload() ) {
 
-	} else
+		Serial.printf( "[LORAWAN   ] [ERROR] Payload of %d bytes exceeds the %d bytes allowed at DR%d, not sent.\n", len, get_max_payload(), LMIC.datarate );
+		return false;
+	}
 
-		mylen = 0;
+	std::fill( mydata.begin(), mydata.end(), 0 );
+	memcpy( mydata.data(), buffer, len );
+	mylen = len;
 
-	send( &sendjob );
+	Serial.printf( "[LORAWAN   ] [INFO ] Sending %d bytes at DR%d, airtime %dms.\n", len, LMIC.datarate, get_airtime_ms( len ));
+	return send( &sendjob );
 }
 
 void AWSLoraWAN::set_joined( bool b )
@@ -312,6 +352,19 @@ void AWSLoraWAN::set_joined( bool b )
 	joined = b;
 }
 
+bool AWSLoraWAN::wait_until_sent( void )
+{
+	unsigned long start = millis();
+
+	while( !_message_sent && (( millis() - start ) < LORAWAN_TX_TIMEOUT_MS ))
+		delay( 100 );
+
+	if ( !_message_sent )
+		Serial.printf( "[LORAWAN   ] [ERROR] Packet still not sent after %ds, giving up.\n", LORAWAN_TX_TIMEOUT_MS / 1000 );
+
+	return _message_sent;
+}
+
 void AWSLoraWAN::static_request_network_time_callback( void *_utc_time, int status ) // NOSONAR
 {
 	const auto *utc_time = static_cast<const uint32_t*>( _utc_time );
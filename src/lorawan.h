@@ -32,6 +32,15 @@ static uint8_t			DEVEUI[8]	= { 0x00 };	// NOSONAR
 static uint8_t			APPKEY[16]	= { 0x00 };	// NOSONAR
 static const uint8_t	APPEUI[8]	= { 0x00 };	// NOSONAR
 
+// EU868 per data rate (DR0..DR7): maximum application payload without FOpts, spreading factor and bandwidth (DR7 is FSK)
+const std::array<uint8_t, 8>	EU868_MAX_PAYLOAD		= { 51, 51, 51, 115, 222, 222, 222, 222 };
+const std::array<uint8_t, 8>	EU868_SPREADING_FACTOR	= { 12, 11, 10, 9, 8, 7, 7, 0 };
+const std::array<uint16_t, 8>	EU868_BANDWIDTH_KHZ		= { 125, 125, 125, 125, 125, 125, 250, 0 };
+const uint8_t					LORAWAN_MAX_PAYLOAD		= 222;
+const uint8_t					LORAWAN_FRAME_OVERHEAD	= 13;		// MHDR + FHDR without FOpts + FPort + MIC
+const uint8_t					LORAWAN_LMIC_MAX_PAYLOAD	= LMIC_MAX_FRAME_LENGTH - LORAWAN_FRAME_OVERHEAD;	// 51 bytes unless LMIC_MAX_FRAME_LENGTH is raised, see README
+const uint32_t					LORAWAN_TX_TIMEOUT_MS	= 300000;	// Covers the 1% duty cycle wait after a DR0 frame
+
 class AWSLoraWAN
 {
 	private:
@@ -44,17 +53,20 @@ class AWSLoraWAN
 		bool					msg_waiting					= false;
 		uint8_t					msg_port;
 		osjob_t					sendjob;
-		std::array<uint8_t,64>	mydata;
+		std::array<uint8_t,LORAWAN_MAX_PAYLOAD>	mydata;
 		uint32_t				mylen;
 		TaskHandle_t			loop_handle;
 
 		void 	loop( void * );
+		bool	wait_until_sent( void );
 
 	public:
 
 					AWSLoraWAN( void );
 		bool		begin( std::array<uint8_t,8>, std::array<uint8_t,16>, _dr_eu868_t, bool );
 		void		empty_queue( void );
+		uint32_t	get_airtime_ms( uint8_t );
+		uint8_t		get_max_payload( void );
 		bool		join( void );
 		bool		has_joined( void );
 		void		message_sent( void );
@@ -64,8 +76,8 @@ class AWSLoraWAN
 		void		request_network_time( void );
 		void		request_network_time_callback( time_t, int );
 		void		restore_after_deep_sleep( void );
-		void		send( osjob_t * );
-		void		send_data( uint8_t *, uint8_t );
+		bool		send( osjob_t * );
+		bool		send_data( uint8_t *, uint8_t );
 		void		set_joined( bool );
 		static void static_request_network_time_callback( void *, int );
 };
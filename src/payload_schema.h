@@ -0,0 +1,621 @@
+/*
+  	payload_schema.h
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//
+// Single description of the compact (LoRaWAN) payload.
+//
+// The firmware encoder, the JSON writer and the backend decoder are all driven by the tables below,
+// so changing the payload only means adding a table to PAYLOAD_SCHEMAS and bumping COMPACT_DATA_FORMAT_VERSION.
+// This header only depends on the C++ standard library so that it can be compiled and checked on a host.
+//
+// A field may depend on a sensor (only sent if its bit is set in the AVAILABLE_SENSORS field) and/or on an
+// optional section (only sent if its bit is set in the SECTIONS field), so these two fields must come first.
+//
+
+#pragma once
+#ifndef _payload_schema_H
+#define _payload_schema_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+const uint8_t COMPACT_DATA_FORMAT_VERSION = 0x06;
+
+enum struct payload_field_t : uint8_t {
+
+	FORMAT_VERSION,
+	SECTIONS,
+	TIMESTAMP,
+	LUX,
+	IRRADIANCE,
+	TEMPERATURE,
+	PRESSURE,
+	RH,
+	AMBIENT_TEMPERATURE,
+	RAW_SKY_TEMPERATURE,
+	SKY_TEMPERATURE,
+	CLOUD_COVER,
+	CLOUD_COVERAGE,
+	MSAS,
+	NELM,
+	DB,
+	LEQ,
+	L10,
+	L50,
+	L90,
+	LMAX,
+	OCTAVE_0,
+	OCTAVE_1,
+	OCTAVE_2,
+	OCTAVE_3,
+	OCTAVE_4,
+	OCTAVE_5,
+	OCTAVE_6,
+	AVAILABLE_SENSORS,
+	BATTERY_LEVEL,
+	UPTIME,
+	FS_FREE_SPACE,
+	RESET_REASON,
+	BUILD_INFO,
+	SLEEP_MINUTES
+};
+
+enum struct payload_encoding_t : uint8_t {
+
+	TRUNCATE,		// trunc( clamp( value ) * scale ), two's complement if signed (format 0x03)
+	OFFSET			// round(( clamp( value ) - min ) * scale ), unsigned
+};
+
+// Same bits as aws_device_t
+const uint32_t PAYLOAD_REQUIRES_MLX		= 0x00000001;
+const uint32_t PAYLOAD_REQUIRES_TSL		= 0x00000002;
+const uint32_t PAYLOAD_REQUIRES_BME		= 0x00000004;
+const uint32_t PAYLOAD_REQUIRES_SPL		= 0x00000800;
+
+const uint8_t PAYLOAD_SECTION_EXTENDED_HEALTH	= 0x01;
+const uint8_t PAYLOAD_SECTION_SPECTRUM			= 0x02;		// Format 0x06 and later
+
+const time_t PAYLOAD_EPOCH				= 1735689600;		// 2025-01-01T00:00:00Z
+
+// JSON value of a field, the type of the reading it comes from whatever its encoding in the payload
+enum struct payload_json_t : uint8_t {
+
+	INTEGER,
+	UNSIGNED,
+	REAL
+};
+
+inline payload_json_t payload_json_type( payload_field_t field )
+{
+	switch ( field ) {
+
+		case payload_field_t::TIMESTAMP:
+		case payload_field_t::LUX:					// -1 when the sensor saturates
+		case payload_field_t::RESET_REASON:
+			return payload_json_t::INTEGER;
+
+		case payload_field_t::IRRADIANCE:
+		case payload_field_t::TEMPERATURE:
+		case payload_field_t::PRESSURE:
+		case payload_field_t::RH:
+		case payload_field_t::AMBIENT_TEMPERATURE:
+		case payload_field_t::RAW_SKY_TEMPERATURE:
+		case payload_field_t::SKY_TEMPERATURE:
+		case payload_field_t::CLOUD_COVER:
+		case payload_field_t::MSAS:
+		case payload_field_t::NELM:
+		case payload_field_t::LEQ:
+		case payload_field_t::BATTERY_LEVEL:
+			return payload_json_t::REAL;
+
+		default:
+			return payload_json_t::UNSIGNED;
+	}
+}
+
+struct payload_field_desc_t {
+
+	payload_field_t		field;
+	const char			*name;			// Also used as JSON key
+	payload_encoding_t	encoding;
+	double				scale;
+	double				min;
+	double				max;
+	uint8_t				bits;
+	bool				is_signed;
+	uint8_t				delta_bits;		// Width of the signed difference with the first reading of a batch, 0 if not repeated
+	uint32_t			required_sensors;	// Sensor bits, 0 if always present
+	uint8_t				section;		// Section bit, 0 if always present
+};
+
+//
+// Format 0x03: byte aligned little-endian fields, identical to the former packed compact_data_t
+//
+constexpr payload_field_desc_t PAYLOAD_SCHEMA_V3[] = {
+
+	{ payload_field_t::FORMAT_VERSION,		"format_version",		payload_encoding_t::TRUNCATE,	1,		0,			255,		8,	false,	0,	0,	0 },
+	{ payload_field_t::TIMESTAMP,			"timestamp",			payload_encoding_t::TRUNCATE,	1,		INT32_MIN,	INT32_MAX,	32,	true,	0,	0,	0 },
+	{ payload_field_t::LUX,					"lux",					payload_encoding_t::TRUNCATE,	100,	0,			80000,		32,	true,	0,	0,	0 },
+	{ payload_field_t::IRRADIANCE,			"irradiance",			payload_encoding_t::TRUNCATE,	100,	0,			1000,		16,	true,	0,	0,	0 },
+	{ payload_field_t::TEMPERATURE,			"temperature",			payload_encoding_t::TRUNCATE,	100,	-40,		50,			16,	true,	0,	0,	0 },
+	{ payload_field_t::PRESSURE,			"pressure",				payload_encoding_t::TRUNCATE,	100,	700,		1050,		32,	true,	0,	0,	0 },
+	{ payload_field_t::RH,					"rh",					payload_encoding_t::TRUNCATE,	100,	0,			100,		16,	true,	0,	0,	0 },
+	{ payload_field_t::AMBIENT_TEMPERATURE,	"ambient_temperature",	payload_encoding_t::TRUNCATE,	100,	-40,		50,			16,	true,	0,	0,	0 },
+	{ payload_field_t::RAW_SKY_TEMPERATURE,	"raw_sky_temperature",	payload_encoding_t::TRUNCATE,	100,	-100,		50,			16,	true,	0,	0,	0 },
+	{ payload_field_t::SKY_TEMPERATURE,		"sky_temperature",		payload_encoding_t::TRUNCATE,	100,	-100,		50,			16,	true,	0,	0,	0 },
+	{ payload_field_t::CLOUD_COVER,			"cloud_cover",			payload_encoding_t::TRUNCATE,	100,	-100,		50,			16,	true,	0,	0,	0 },
+	{ payload_field_t::CLOUD_COVERAGE,		"cloud_coverage",		payload_encoding_t::TRUNCATE,	1,		0,			255,		8,	false,	0,	0,	0 },
+	{ payload_field_t::MSAS,				"msas",					payload_encoding_t::TRUNCATE,	100,	0,			30,			16,	true,	0,	0,	0 },
+	{ payload_field_t::NELM,				"nelm",					payload_encoding_t::TRUNCATE,	100,	-15,		10,			16,	true,	0,	0,	0 },
+	{ payload_field_t::DB,					"db",					payload_encoding_t::TRUNCATE,	1,		0,			255,		8,	false,	0,	0,	0 },
+	{ payload_field_t::AVAILABLE_SENSORS,	"available_sensors",	payload_encoding_t::TRUNCATE,	1,		0,			UINT32_MAX,	32,	false,	0,	0,	0 },
+	{ payload_field_t::BATTERY_LEVEL,		"battery_level",		payload_encoding_t::TRUNCATE,	100,	0,			100,		16,	true,	0,	0,	0 },
+	{ payload_field_t::UPTIME,				"uptime",				payload_encoding_t::TRUNCATE,	1,		0,			UINT32_MAX,	32,	false,	0,	0,	0 },
+	{ payload_field_t::FS_FREE_SPACE,		"fs_free_space",		payload_encoding_t::TRUNCATE,	1,		0,			UINT32_MAX,	32,	false,	0,	0,	0 },
+	{ payload_field_t::RESET_REASON,		"reset_reason",			payload_encoding_t::TRUNCATE,	1,		0,			UINT32_MAX,	32,	false,	0,	0,	0 },
+	{ payload_field_t::BUILD_INFO,			"build_info",			payload_encoding_t::TRUNCATE,	1,		0,			UINT32_MAX,	32,	false,	0,	0,	0 },
+	{ payload_field_t::SLEEP_MINUTES,		"sleep_minutes",		payload_encoding_t::TRUNCATE,	1,		0,			UINT16_MAX,	16,	false,	0,	0,	0 }
+};
+
+//
+// Formats 0x04 and later are built from the same groups of fields, each version adding its own groups: only the
+// sections field, which grows with the number of optional sections, is written out in every table
+//
+#define PAYLOAD_FIELDS_HEADER \
+	{ payload_field_t::FORMAT_VERSION,		"format_version",		payload_encoding_t::OFFSET,	1,			0,				255,						8,	false,	0,	0,						0 }, \
+	{ payload_field_t::AVAILABLE_SENSORS,	"available_sensors",	payload_encoding_t::OFFSET,	1,			0,				UINT16_MAX,					16,	false,	0,	0,						0 }
+
+#define PAYLOAD_FIELDS_READINGS \
+	{ payload_field_t::TIMESTAMP,			"timestamp",			payload_encoding_t::OFFSET,	1,			PAYLOAD_EPOCH,	PAYLOAD_EPOCH + 0x0FFFFFFF,	28,	false,	16,	0,						0 }, \
+	{ payload_field_t::LUX,					"lux",					payload_encoding_t::OFFSET,	1,			0,				88000,						17,	false,	12,	PAYLOAD_REQUIRES_TSL,	0 }, \
+	{ payload_field_t::IRRADIANCE,			"irradiance",			payload_encoding_t::OFFSET,	10,			0,				1000,						14,	false,	12,	PAYLOAD_REQUIRES_TSL,	0 }, \
+	{ payload_field_t::MSAS,				"msas",					payload_encoding_t::OFFSET,	100,		0,				30,							12,	false,	10,	PAYLOAD_REQUIRES_TSL,	0 }, \
+	{ payload_field_t::NELM,				"nelm",					payload_encoding_t::OFFSET,	100,		-15,			10,							12,	false,	10,	PAYLOAD_REQUIRES_TSL,	0 }, \
+	{ payload_field_t::TEMPERATURE,			"temperature",			payload_encoding_t::OFFSET,	100,		-40,			50,							14,	false,	10,	PAYLOAD_REQUIRES_BME,	0 }, \
+	{ payload_field_t::PRESSURE,			"pressure",				payload_encoding_t::OFFSET,	10,			700,			1050,						12,	false,	8,	PAYLOAD_REQUIRES_BME,	0 }, \
+	{ payload_field_t::RH,					"rh",					payload_encoding_t::OFFSET,	10,			0,				100,						10,	false,	9,	PAYLOAD_REQUIRES_BME,	0 }, \
+	{ payload_field_t::AMBIENT_TEMPERATURE,	"ambient_temperature",	payload_encoding_t::OFFSET,	100,		-40,			50,							14,	false,	10,	PAYLOAD_REQUIRES_MLX,	0 }, \
+	{ payload_field_t::RAW_SKY_TEMPERATURE,	"raw_sky_temperature",	payload_encoding_t::OFFSET,	100,		-100,			50,							14,	false,	11,	PAYLOAD_REQUIRES_MLX,	0 }, \
+	{ payload_field_t::SKY_TEMPERATURE,		"sky_temperature",		payload_encoding_t::OFFSET,	100,		-100,			50,							14,	false,	11,	PAYLOAD_REQUIRES_MLX,	0 }, \
+	{ payload_field_t::CLOUD_COVER,			"cloud_cover",			payload_encoding_t::OFFSET,	100,		-100,			50,							14,	false,	11,	PAYLOAD_REQUIRES_MLX,	0 }, \
+	{ payload_field_t::CLOUD_COVERAGE,		"cloud_coverage",		payload_encoding_t::OFFSET,	1,			0,				3,							2,	false,	3,	PAYLOAD_REQUIRES_MLX,	0 }, \
+	{ payload_field_t::DB,					"db",					payload_encoding_t::OFFSET,	1,			0,				255,						8,	false,	6,	PAYLOAD_REQUIRES_SPL,	0 }
+
+#define PAYLOAD_FIELDS_NOISE \
+	{ payload_field_t::LEQ,					"leq",					payload_encoding_t::OFFSET,	2,			20,				147.5,						8,	false,	6,	PAYLOAD_REQUIRES_SPL,	0 }, \
+	{ payload_field_t::L10,					"l10",					payload_encoding_t::OFFSET,	1,			20,				147,						7,	false,	5,	PAYLOAD_REQUIRES_SPL,	0 }, \
+	{ payload_field_t::L50,					"l50",					payload_encoding_t::OFFSET,	1,			20,				147,						7,	false,	5,	PAYLOAD_REQUIRES_SPL,	0 }, \
+	{ payload_field_t::L90,					"l90",					payload_encoding_t::OFFSET,	1,			20,				147,						7,	false,	5,	PAYLOAD_REQUIRES_SPL,	0 }, \
+	{ payload_field_t::LMAX,				"lmax",					payload_encoding_t::OFFSET,	1,			20,				147,						7,	false,	5,	PAYLOAD_REQUIRES_SPL,	0 }
+
+#define PAYLOAD_FIELDS_SPECTRUM \
+	{ payload_field_t::OCTAVE_0,			"octave_0",				payload_encoding_t::OFFSET,	.2,			20,				95,							4,	false,	0,	PAYLOAD_REQUIRES_SPL,	PAYLOAD_SECTION_SPECTRUM }, \
+	{ payload_field_t::OCTAVE_1,			"octave_1",				payload_encoding_t::OFFSET,	.2,			20,				95,							4,	false,	0,	PAYLOAD_REQUIRES_SPL,	PAYLOAD_SECTION_SPECTRUM }, \
+	{ payload_field_t::OCTAVE_2,			"octave_2",				payload_encoding_t::OFFSET,	.2,			20,				95,							4,	false,	0,	PAYLOAD_REQUIRES_SPL,	PAYLOAD_SECTION_SPECTRUM }, \
+	{ payload_field_t::OCTAVE_3,			"octave_3",				payload_encoding_t::OFFSET,	.2,			20,				95,							4,	false,	0,	PAYLOAD_REQUIRES_SPL,	PAYLOAD_SECTION_SPECTRUM }, \
+	{ payload_field_t::OCTAVE_4,			"octave_4",				payload_encoding_t::OFFSET,	.2,			20,				95,							4,	false,	0,	PAYLOAD_REQUIRES_SPL,	PAYLOAD_SECTION_SPECTRUM }, \
+	{ payload_field_t::OCTAVE_5,			"octave_5",				payload_encoding_t::OFFSET,	.2,			20,				95,							4,	false,	0,	PAYLOAD_REQUIRES_SPL,	PAYLOAD_SECTION_SPECTRUM }, \
+	{ payload_field_t::OCTAVE_6,			"octave_6",				payload_encoding_t::OFFSET,	.2,			20,				95,							4,	false,	0,	PAYLOAD_REQUIRES_SPL,	PAYLOAD_SECTION_SPECTRUM }
+
+#define PAYLOAD_FIELDS_HEALTH \
+	{ payload_field_t::BATTERY_LEVEL,		"battery_level",		payload_encoding_t::OFFSET,	2,			0,				100,						8,	false,	5,	0,						0 }, \
+	{ payload_field_t::UPTIME,				"uptime",				payload_encoding_t::OFFSET,	1. / 60,	0,				0xFFFFF * 60.,				20,	false,	16,	0,						0 }, \
+	{ payload_field_t::RESET_REASON,		"reset_reason",			payload_encoding_t::OFFSET,	1,			0,				15,							4,	false,	0,	0,						PAYLOAD_SECTION_EXTENDED_HEALTH }, \
+	{ payload_field_t::BUILD_INFO,			"build_info",			payload_encoding_t::OFFSET,	1,			0,				UINT32_MAX,					32,	false,	0,	0,						PAYLOAD_SECTION_EXTENDED_HEALTH }, \
+	{ payload_field_t::FS_FREE_SPACE,		"fs_free_space",		payload_encoding_t::OFFSET,	1. / 1024,	0,				UINT16_MAX * 1024.,			16,	false,	0,	0,						PAYLOAD_SECTION_EXTENDED_HEALTH }, \
+	{ payload_field_t::SLEEP_MINUTES,		"sleep_minutes",		payload_encoding_t::OFFSET,	1,			0,				UINT16_MAX,					16,	false,	0,	0,						PAYLOAD_SECTION_EXTENDED_HEALTH }
+
+//
+// Format 0x04: bit packed fields at their actual resolution, fields of absent sensors are dropped,
+// timestamp relative to PAYLOAD_EPOCH, static health data only in the optional extended section
+//
+constexpr payload_field_desc_t PAYLOAD_SCHEMA_V4[] = {
+
+	PAYLOAD_FIELDS_HEADER,
+	{ payload_field_t::SECTIONS,			"sections",				payload_encoding_t::OFFSET,	1,			0,				1,							1,	false,	0,	0,						0 },
+	PAYLOAD_FIELDS_READINGS,
+	PAYLOAD_FIELDS_HEALTH
+};
+
+//
+// Format 0x05: format 0x04 plus the noise descriptors of the reporting interval (Leq, L10, L50, L90, Lmax)
+//
+constexpr payload_field_desc_t PAYLOAD_SCHEMA_V5[] = {
+
+	PAYLOAD_FIELDS_HEADER,
+	{ payload_field_t::SECTIONS,			"sections",				payload_encoding_t::OFFSET,	1,			0,				1,							1,	false,	0,	0,						0 },
+	PAYLOAD_FIELDS_READINGS,
+	PAYLOAD_FIELDS_NOISE,
+	PAYLOAD_FIELDS_HEALTH
+};
+
+//
+// Format 0x06: format 0x05 plus an optional spectrum section, the octave band levels of the reporting interval
+// on 4 bits (5dB steps from 20dB)
+//
+constexpr payload_field_desc_t PAYLOAD_SCHEMA_V6[] = {
+
+	PAYLOAD_FIELDS_HEADER,
+	{ payload_field_t::SECTIONS,			"sections",				payload_encoding_t::OFFSET,	1,			0,				3,							2,	false,	0,	0,						0 },
+	PAYLOAD_FIELDS_READINGS,
+	PAYLOAD_FIELDS_NOISE,
+	PAYLOAD_FIELDS_SPECTRUM,
+	PAYLOAD_FIELDS_HEALTH
+};
+
+#undef PAYLOAD_FIELDS_HEADER
+#undef PAYLOAD_FIELDS_READINGS
+#undef PAYLOAD_FIELDS_NOISE
+#undef PAYLOAD_FIELDS_SPECTRUM
+#undef PAYLOAD_FIELDS_HEALTH
+
+struct payload_schema_t {
+
+	uint8_t						version;
+	const payload_field_desc_t	*fields;
+	size_t						count;
+};
+
+constexpr payload_schema_t PAYLOAD_SCHEMAS[] = {
+
+	{ 0x03, PAYLOAD_SCHEMA_V3, sizeof( PAYLOAD_SCHEMA_V3 ) / sizeof( payload_field_desc_t ) },
+	{ 0x04, PAYLOAD_SCHEMA_V4, sizeof( PAYLOAD_SCHEMA_V4 ) / sizeof( payload_field_desc_t ) },
+	{ 0x05, PAYLOAD_SCHEMA_V5, sizeof( PAYLOAD_SCHEMA_V5 ) / sizeof( payload_field_desc_t ) },
+	{ 0x06, PAYLOAD_SCHEMA_V6, sizeof( PAYLOAD_SCHEMA_V6 ) / sizeof( payload_field_desc_t ) }
+};
+
+// DR0 in EU868
+const size_t PAYLOAD_MAX_SIZE = 51;
+
+constexpr size_t payload_schema_bits( const payload_field_desc_t *fields, size_t count )
+{
+	return count ? fields[0].bits + payload_schema_bits( fields + 1, count - 1 ) : 0;
+}
+
+// Size with all sensors present and all sections sent
+constexpr size_t payload_schema_size( const payload_schema_t &schema )
+{
+	return ( payload_schema_bits( schema.fields, schema.count ) + 7 ) / 8;
+}
+
+static_assert( payload_schema_size( PAYLOAD_SCHEMAS[0] ) == 57, "Format 0x03 must keep the layout of the former packed compact_data_t" );
+static_assert( payload_schema_size( PAYLOAD_SCHEMAS[1] ) <= PAYLOAD_MAX_SIZE, "Format 0x04 must fit in a DR0 uplink" );
+static_assert( payload_schema_size( PAYLOAD_SCHEMAS[2] ) <= PAYLOAD_MAX_SIZE, "Format 0x05 must fit in a DR0 uplink" );
+static_assert( payload_schema_size( PAYLOAD_SCHEMAS[3] ) <= PAYLOAD_MAX_SIZE, "Format 0x06 must fit in a DR0 uplink" );
+
+inline const payload_schema_t *payload_get_schema( uint8_t version )
+{
+	for ( const payload_schema_t &schema : PAYLOAD_SCHEMAS )
+		if ( schema.version == version )
+			return &schema;
+
+	return nullptr;
+}
+
+//
+// Fields are written LSB first, so byte aligned fields come out little-endian like the packed struct did
+//
+class PayloadBitWriter {
+
+	public:
+
+		PayloadBitWriter( uint8_t *_buffer, size_t _size ) : buffer( _buffer ), size( _size ) {}
+
+		bool write( uint64_t value, uint8_t bits )
+		{
+			if (( bit_pos + bits ) > ( size * 8 ))
+				return false;
+
+			for ( uint8_t i = 0; i < bits; i++, bit_pos++ ) {
+
+				if ( !( bit_pos % 8 ))
+					buffer[ bit_pos / 8 ] = 0;
+				buffer[ bit_pos / 8 ] |= static_cast<uint8_t>((( value >> i ) & 1 ) << ( bit_pos % 8 ));
+			}
+			return true;
+		}
+
+		size_t get_size( void ) const { return ( bit_pos + 7 ) / 8; }
+
+	private:
+
+		uint8_t	*buffer;
+		size_t	size;
+		size_t	bit_pos	= 0;
+};
+
+class PayloadBitReader {
+
+	public:
+
+		PayloadBitReader( const uint8_t *_buffer, size_t _size ) : buffer( _buffer ), size( _size ) {}
+
+		bool read( uint8_t bits, uint64_t &value )
+		{
+			if (( bit_pos + bits ) > ( size * 8 ))
+				return false;
+
+			value = 0;
+			for ( uint8_t i = 0; i < bits; i++, bit_pos++ )
+				value |= static_cast<uint64_t>(( buffer[ bit_pos / 8 ] >> ( bit_pos % 8 )) & 1 ) << i;
+			return true;
+		}
+
+	private:
+
+		const uint8_t	*buffer;
+		size_t			size;
+		size_t			bit_pos	= 0;
+};
+
+inline uint64_t payload_quantise( const payload_field_desc_t &desc, double value )
+{
+	int64_t raw;
+
+	if ( !( value >= desc.min ))		// Also catches NaN
+		value = desc.min;
+	else if ( value > desc.max )
+		value = desc.max;
+
+	if ( desc.encoding == payload_encoding_t::OFFSET )
+		raw = static_cast<int64_t>(( value - desc.min ) * desc.scale + .5 );
+	else
+		raw = static_cast<int64_t>( value * desc.scale );
+
+	// Saturate rather than wrap when the clamp range exceeds the field width (e.g. irradiance in 0x03)
+	int64_t high	= desc.is_signed ? ( INT64_C( 1 ) << ( desc.bits - 1 )) - 1 : ( INT64_C( 1 ) << desc.bits ) - 1;
+	int64_t low		= desc.is_signed ? -( INT64_C( 1 ) << ( desc.bits - 1 )) : 0;
+
+	if ( raw > high )
+		raw = high;
+	else if ( raw < low )
+		raw = low;
+
+	return static_cast<uint64_t>( raw ) & (( UINT64_C( 1 ) << desc.bits ) - 1 );
+}
+
+inline int64_t payload_sign_extend( uint64_t raw, uint8_t bits )
+{
+	auto value = static_cast<int64_t>( raw );
+
+	if ( raw & ( UINT64_C( 1 ) << ( bits - 1 )))
+		value -= INT64_C( 1 ) << bits;
+
+	return value;
+}
+
+inline double payload_dequantise( const payload_field_desc_t &desc, uint64_t raw )
+{
+	int64_t value = desc.is_signed ? payload_sign_extend( raw, desc.bits ) : static_cast<int64_t>( raw );
+
+	if ( desc.encoding == payload_encoding_t::OFFSET )
+		return desc.min + static_cast<double>( value ) / desc.scale;
+
+	return static_cast<double>( value ) / desc.scale;
+}
+
+//
+// Tracks the presence fields while walking a schema, identically on the encoding and decoding sides
+//
+class PayloadPresence {
+
+	public:
+
+		bool is_present( const payload_field_desc_t &desc ) const
+		{
+			return ( !desc.required_sensors || ( available_sensors & desc.required_sensors )) && ( !desc.section || ( sections & desc.section ));
+		}
+
+		void update( const payload_field_desc_t &desc, uint64_t raw )
+		{
+			if ( desc.field == payload_field_t::AVAILABLE_SENSORS )
+				available_sensors = static_cast<uint32_t>( payload_dequantise( desc, raw ));
+			else if ( desc.field == payload_field_t::SECTIONS )
+				sections = static_cast<uint8_t>( payload_dequantise( desc, raw ));
+		}
+
+	private:
+
+		uint32_t	available_sensors	= 0;
+		uint8_t		sections			= 0;
+};
+
+const uint8_t	PAYLOAD_BATCH_FLAG			= 0x80;		// Set in the format version byte of a batch
+const uint8_t	PAYLOAD_BATCH_MAX_READINGS	= 16;		// Reading count is sent on 4 bits
+const size_t	PAYLOAD_MAX_FIELDS			= 48;
+
+static_assert( sizeof( PAYLOAD_SCHEMA_V4 ) / sizeof( payload_field_desc_t ) <= PAYLOAD_MAX_FIELDS, "Too many fields in format 0x04" );
+static_assert( sizeof( PAYLOAD_SCHEMA_V5 ) / sizeof( payload_field_desc_t ) <= PAYLOAD_MAX_FIELDS, "Too many fields in format 0x05" );
+static_assert( sizeof( PAYLOAD_SCHEMA_V6 ) / sizeof( payload_field_desc_t ) <= PAYLOAD_MAX_FIELDS, "Too many fields in format 0x06" );
+
+// Quantised values of one reading, indexed like the schema fields, absent fields are left to 0
+struct payload_raw_reading_t {
+
+	uint32_t	raw[ PAYLOAD_MAX_FIELDS ];
+};
+
+inline bool payload_write_fields( PayloadBitWriter &writer, const payload_schema_t &schema, size_t first, PayloadPresence &presence, const payload_raw_reading_t &reading )
+{
+	for ( size_t i = first; i < schema.count; i++ ) {
+
+		if ( !presence.is_present( schema.fields[ i ] ))
+			continue;
+
+		if ( !writer.write( reading.raw[ i ], schema.fields[ i ].bits ))
+			return false;
+		presence.update( schema.fields[ i ], reading.raw[ i ] );
+	}
+	return true;
+}
+
+inline bool payload_read_fields( PayloadBitReader &reader, const payload_schema_t &schema, size_t first, PayloadPresence &presence, payload_raw_reading_t &reading )
+{
+	uint64_t raw;
+
+	for ( size_t i = first; i < schema.count; i++ ) {
+
+		reading.raw[ i ] = 0;
+		if ( !presence.is_present( schema.fields[ i ] ))
+			continue;
+
+		if ( !reader.read( schema.fields[ i ].bits, raw ))
+			return false;
+		reading.raw[ i ] = static_cast<uint32_t>( raw );
+		presence.update( schema.fields[ i ], raw );
+	}
+	return true;
+}
+
+//
+// get_value( payload_field_t ) returns the physical value of a field, the encoded size is returned (0 if the buffer is too small)
+//
+template <typename Getter>
+size_t payload_encode( const payload_schema_t &schema, Getter get_value, uint8_t *buffer, size_t size )
+{
+	PayloadBitWriter		writer( buffer, size );
+	PayloadPresence			presence;
+	payload_raw_reading_t	reading;
+
+	for ( size_t i = 0; i < schema.count; i++ )
+		reading.raw[ i ] = static_cast<uint32_t>( payload_quantise( schema.fields[ i ], get_value( schema.fields[ i ].field )));
+
+	return payload_write_fields( writer, schema, 0, presence, reading ) ? writer.get_size() : 0;
+}
+
+//
+// Batch of single reading frames (as produced by payload_encode) into one frame:
+//   - format version | PAYLOAD_BATCH_FLAG, reading count - 1 on 4 bits
+//   - the first reading, in full
+//   - for each following reading, the difference with the first one of every field having a delta width
+//
+// The other fields must be identical in all readings, except SECTIONS and the fields of optional sections
+// which describe the first reading only. Returns 0 if the readings cannot be batched or if the frame does not fit.
+//
+inline size_t payload_encode_batch( const uint8_t *const *frames, const size_t *sizes, uint8_t count, uint8_t *buffer, size_t size )
+{
+	const payload_schema_t	*schema;
+	payload_raw_reading_t	first;
+	payload_raw_reading_t	reading;
+	PayloadPresence			presence;
+
+	if ( !count || ( count > PAYLOAD_BATCH_MAX_READINGS ) || !sizes[0] || ( frames[0][0] & PAYLOAD_BATCH_FLAG ) || !( schema = payload_get_schema( frames[0][0] )))
+		return 0;
+
+	PayloadBitReader first_reader( frames[0], sizes[0] );
+	if ( !payload_read_fields( first_reader, *schema, 0, presence, first ))
+		return 0;
+
+	PayloadBitWriter	writer( buffer, size );
+	PayloadPresence		write_presence;
+
+	if ( !writer.write( schema->version | PAYLOAD_BATCH_FLAG, 8 ) || !writer.write( count - 1, 4 ) || !payload_write_fields( writer, *schema, 1, write_presence, first ))
+		return 0;
+
+	for ( uint8_t k = 1; k < count; k++ ) {
+
+		PayloadPresence reading_presence;
+
+		if ( !sizes[k] || ( frames[k][0] != schema->version ))
+			return 0;
+
+		PayloadBitReader reader( frames[k], sizes[k] );
+		if ( !payload_read_fields( reader, *schema, 0, reading_presence, reading ))
+			return 0;
+
+		for ( size_t i = 0; i < schema->count; i++ ) {
+
+			const payload_field_desc_t &desc = schema->fields[ i ];
+
+			if ( !presence.is_present( desc ) || desc.section || ( desc.field == payload_field_t::SECTIONS ))
+				continue;
+
+			if ( !desc.delta_bits ) {
+
+				if ( reading.raw[ i ] != first.raw[ i ] )
+					return 0;
+				continue;
+			}
+
+			int64_t delta = static_cast<int64_t>( reading.raw[ i ] ) - first.raw[ i ];
+			int64_t limit = INT64_C( 1 ) << ( desc.delta_bits - 1 );
+
+			if (( delta < -limit ) || ( delta >= limit ) || !writer.write( static_cast<uint64_t>( delta ), desc.delta_bits ))
+				return 0;
+		}
+	}
+
+	return writer.get_size();
+}
+
+//
+// Host side decoder for single and batch frames: callback( uint8_t reading, const payload_field_desc_t &, double )
+// is called for each field present in each reading
+//
+template <typename Callback>
+bool payload_decode( const uint8_t *buffer, size_t size, Callback callback )
+{
+	const payload_schema_t	*schema;
+	payload_raw_reading_t	first;
+	PayloadPresence			presence;
+	uint64_t				raw;
+	uint64_t				count	= 0;
+
+	if ( !size || !( schema = payload_get_schema( buffer[0] & ~PAYLOAD_BATCH_FLAG )))
+		return false;
+
+	PayloadBitReader reader( buffer, size );
+
+	if ( buffer[0] & PAYLOAD_BATCH_FLAG ) {
+
+		first.raw[0] = schema->version;
+		if ( !reader.read( 8, raw ) || !reader.read( 4, count ) || !payload_read_fields( reader, *schema, 1, presence, first ))
+			return false;
+
+	} else if ( !payload_read_fields( reader, *schema, 0, presence, first ))
+		return false;
+
+	for ( size_t i = 0; i < schema->count; i++ )
+		if ( presence.is_present( schema->fields[ i ] ))
+			callback( 0, schema->fields[ i ], payload_dequantise( schema->fields[ i ], first.raw[ i ] ));
+
+	for ( uint8_t k = 1; k <= count; k++ ) {
+
+		for ( size_t i = 0; i < schema->count; i++ ) {
+
+			const payload_field_desc_t &desc = schema->fields[ i ];
+
+			if ( !presence.is_present( desc ) || desc.section || ( desc.field == payload_field_t::SECTIONS ))
+				continue;
+
+			raw = first.raw[ i ];
+			if ( desc.delta_bits ) {
+
+				uint64_t delta;
+				if ( !reader.read( desc.delta_bits, delta ))
+					return false;
+				raw += payload_sign_extend( delta, desc.delta_bits );
+			}
+			callback( k, desc, payload_dequantise( desc, raw ));
+		}
+	}
+	return true;
+}
+
+#endif
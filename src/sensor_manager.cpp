@@ -18,6 +18,7 @@
 */
 
 #include <esp_task_wdt.h>
+#include <Wire.h>
 #include <ESP32Time.h>
 // Keep these two to get rid of compile time errors because of incompatibilities between libraries
 #include <ESPAsyncWebServer.h>
@@ -28,13 +29,14 @@
 #include "config_manager.h"
 #include "SQM.h"
 #include "device.h"
+#include "fast_math.h"
 #include "sensor_manager.h"
 #include "EcoStation.h"
 
 RTC_DATA_ATTR long	prev_available_sensors = 0;	// NOSONAR
 RTC_DATA_ATTR long	available_sensors = 0;		// NOSONAR
+RTC_DATA_ATTR sensor_cache_t	sensor_cache;	// NOSONAR
 
-SemaphoreHandle_t sensors_read_mutex = NULL;	// Issue #7
 const aws_device_t ALL_SENSORS	= ( aws_device_t::MLX_SENSOR |
 									aws_device_t::TSL_SENSOR |
 									aws_device_t::BME_SENSOR |
@@ -85,32 +87,50 @@ aws_device_t& operator&=( aws_device_t& a, aws_device_t b )
 }
 
 AWSSensorManager::AWSSensorManager( void ) :
-	i2c_mutex( xSemaphoreCreateMutex() ),
 	tsl ( 2591 )
 {
 	memset( &sensor_data, 0, sizeof( sensor_data_t ));
 	sensor_data.available_sensors	= aws_device_t::NO_SENSOR;
+	published_sensor_data			= sensor_data;
+	sqm_reading						= sensor_data.sqm;
+
+	sensor_jobs = {{
+		{ aws_device_t::BME_SENSOR, "bme", BME_I2C_ADDR, &AWSSensorManager::read_BME, &AWSSensorManager::initialise_BME, false, this, nullptr, {}, {} },
+		{ aws_device_t::MLX_SENSOR, "mlx", MLX90614_I2CADDR, &AWSSensorManager::read_MLX, &AWSSensorManager::initialise_MLX, false, this, nullptr, {}, {} },
+		{ aws_device_t::TSL_SENSOR, "tsl", TSL2591_ADDR, &AWSSensorManager::read_TSL, &AWSSensorManager::initialise_TSL, true, this, nullptr, {}, {} },
+		{ aws_device_t::SPL_SENSOR, "spl", static_cast<uint8_t>( spl_hw_t::DBM_I2C_ADDR ), &AWSSensorManager::read_dbmeter, &AWSSensorManager::initialise_dbmeter, false, this, nullptr, {}, {} }
+	}};
 
 }
 
-int16_t AWSSensorManager::float_to_int16_encode( float v, float min, float max )
+// True once after each change of the available sensors, the station then reports them. The other devices are ignored.
+bool AWSSensorManager::availability_changed( void )
 {
-	if ( v < min )
-		v = min;
-	else if ( v > max )
-		v = max;
+	auto sensors = static_cast<long>( sensor_data.available_sensors & ALL_SENSORS );
+
+	if ( prev_available_sensors == sensors )
+		return false;
 
-	return static_cast<int16_t>( v * 100 );
+	prev_available_sensors = sensors;
+	return true;
 }
 
-int32_t AWSSensorManager::float_to_int32_encode( float v, float min, float max )
+//
+// Ends the noise reporting interval: the indices of every sample taken so far, including those of an integration
+// still running, are published and the histogram starts again. The SPL job only adds samples while holding the bus.
+//
+void AWSSensorManager::close_noise_interval( void )
 {
-	if ( v < min )
-		v = min;
-	else if ( v > max )
-		v = max;
+	i2c_bus.lock( I2C_NO_DEVICE, i2c_priority_t::NORMAL, I2C_NO_TIMEOUT );
+
+	if ( sensor_is_available( aws_device_t::SPL_SENSOR )) {
+
+		spl.get_noise_indices( sensor_data.noise );
+		spl.reset_noise_indices();
+		publish_sensor_data();
+	}
 
-	return static_cast<int32_t>( v * 100 );
+	i2c_bus.unlock( I2C_NO_DEVICE, true );
 }
 
 aws_device_t AWSSensorManager::get_available_sensors( void )
@@ -118,14 +138,15 @@ aws_device_t AWSSensorManager::get_available_sensors( void )
 	return sensor_data.available_sensors;
 }
 
-bool AWSSensorManager::get_debug_mode( void )
+// Bumped at each publication, lets consumers reuse what they derived from the previous snapshot
+uint32_t AWSSensorManager::get_data_generation( void )
 {
-	return debug_mode;
+	return publish_sequence.load( std::memory_order_acquire ) >> 1;
 }
 
-SemaphoreHandle_t AWSSensorManager::get_i2c_mutex( void )
+bool AWSSensorManager::get_debug_mode( void )
 {
-	return i2c_mutex;
+	return debug_mode;
 }
 
 sensor_data_t *AWSSensorManager::get_sensor_data( void )
@@ -133,63 +154,105 @@ sensor_data_t *AWSSensorManager::get_sensor_data( void )
 	return &sensor_data;
 }
 
-bool AWSSensorManager::initialise( AWSConfig *_config, compact_data_t *_compact_data, bool create_mutex )
+const char *AWSSensorManager::get_sensor_job_name( uint8_t i )
+{
+	return ( i < SENSOR_JOB_COUNT ) ? sensor_jobs[ i ].name : "unknown";
+}
+
+// Returns false if the sensor has not been read by its own task yet
+bool AWSSensorManager::get_sensor_job_stats( uint8_t i, sensor_job_stats_t &stats )
+{
+	if (( i >= SENSOR_JOB_COUNT ) || !sensor_jobs[ i ].stats.runs )
+		return false;
+
+	stats = sensor_jobs[ i ].stats;
+	return true;
+}
+
+//
+// Seqlock read: never blocks the acquisition task, retries in the unlikely case a publication
+// happened during the copy. Returns the generation of the snapshot.
+//
+uint32_t AWSSensorManager::get_sensor_snapshot( sensor_data_t &snapshot )
+{
+	uint32_t	before;
+	uint32_t	after;
+
+	do {
+
+		// The writer holds publish_mux for a few microseconds only
+		while (( before = publish_sequence.load( std::memory_order_acquire )) & 1 );
+
+		memcpy( &snapshot, &published_sensor_data, sizeof( sensor_data_t ));
+		std::atomic_thread_fence( std::memory_order_acquire );
+		after = publish_sequence.load( std::memory_order_relaxed );
+
+	} while ( before != after );
+
+	return before >> 1;
+}
+
+bool AWSSensorManager::initialise( AWSConfig *_config, bool start_jobs )
 {
 	config = _config;
-	compact_data = _compact_data;
 
 	initialise_sensors();
 
-	if ( !solar_panel || create_mutex ) {
-
-		sensors_read_mutex = xSemaphoreCreateMutex();
-		std::function<void(void *)> _poll_sensors_task = std::bind( &AWSSensorManager::poll_sensors_task, this, std::placeholders::_1 );
-		xTaskCreatePinnedToCore(
-			[](void *param) {	// NOSONAR
-				std::function<void(void*)>* poll_proxy = static_cast<std::function<void(void*)>*>( param );
-				(*poll_proxy)( NULL );
-			}, "SensorManagerTask", 10000, &_poll_sensors_task, 5, &sensors_task_handle, 1 );
-	}
-	k[0] = config->get_parameter<int>( "k1" );
-	k[1] = config->get_parameter<int>( "k2" );
-	k[2] = config->get_parameter<int>( "k3" );
-	k[3] = config->get_parameter<int>( "k4" );
-	k[4] = config->get_parameter<int>( "k5" );
-	k[5] = config->get_parameter<int>( "k6" );
-	k[6] = config->get_parameter<int>( "k7" );
+	if ( !solar_panel || start_jobs )
+		start_sensor_jobs();
 
 	initialised = true;
 	return true;
 }
 
+// A read failed: the device will be probed again at the next initialisation
+void AWSSensorManager::forget_sensor( aws_device_t sensor )
+{
+	sensor_cache.present_sensors &= ~sensor;
+}
+
 void AWSSensorManager::initialise_dbmeter( void )
 {
-	uint8_t seconds = config->get_parameter<uint8_t>( "spl_duration" );
-	uint8_t spl_mode = config->get_parameter<uint8_t>( "spl_mode" );
+	uint8_t seconds = config->get_compiled_config().spl_duration;
+	uint8_t spl_mode = config->get_compiled_config().spl_mode;
+	uint8_t spectrum_bins = config->get_compiled_config().spl_spectrum;
+	bool	cached = sensor_is_cached( aws_device_t::SPL_SENSOR );
+
+	if ( cached ? !spl.begin( sensor_cache.dbm_identity, spl_mode, seconds, spectrum_bins ) : !spl.begin( spl_mode, seconds, spectrum_bins ) ) {
 
-	if ( !spl.begin( spl_mode, seconds ) )
 		Serial.printf( "[SENSORMNGR] [ERROR] Could not find DBMETER.\n" );
+		forget_sensor( aws_device_t::SPL_SENSOR );
 
-	else {
+	} else {
 
 		if ( debug_mode )
-			Serial.printf( "[SENSORMNGR] [INFO ] Found DBMETER.\n" );
+			Serial.printf( "[SENSORMNGR] [INFO ] Found DBMETER%s.\n", cached ? " (cached)" : "" );
 
+		if ( !cached )
+			spl.get_identity( sensor_cache.dbm_identity );
+		sensor_cache.present_sensors |= aws_device_t::SPL_SENSOR;
 		sensor_data.available_sensors |= aws_device_t::SPL_SENSOR;
 	}
 }
 
 void AWSSensorManager::initialise_BME( void )
 {
-	if ( !bme.begin( 0x76 ) )
+	uint8_t	profile = config->get_compiled_config().bme_profile;
+	bool	cached = sensor_is_cached( aws_device_t::BME_SENSOR );
+
+	if ( cached ? !bme.initialise( sensor_cache.bme_calibration, profile ) : !bme.initialise( profile ) ) {
 
 		Serial.printf( "[SENSORMNGR] [ERROR] Could not find BME280.\n" );
+		forget_sensor( aws_device_t::BME_SENSOR );
 
-	else {
+	} else {
 
 		if ( debug_mode )
-			Serial.printf( "[SENSORMNGR] [INFO ] Found BME280.\n" );
+			Serial.printf( "[SENSORMNGR] [INFO ] Found BME280%s.\n", cached ? " (cached)" : "" );
 
+		if ( !cached )
+			bme.get_calibration( sensor_cache.bme_calibration );
+		sensor_cache.present_sensors |= aws_device_t::BME_SENSOR;
 		sensor_data.available_sensors |= aws_device_t::BME_SENSOR;
 	}
 }
@@ -209,21 +272,36 @@ void AWSSensorManager::initialise_MLX( void )
 	}
 }
 
-void AWSSensorManager::initialise_sensors( void )
+// Runs the driver initialisation at the sensor's bus clock
+void AWSSensorManager::initialise_sensor( sensor_job_t &job )
 {
-	if ( config->get_has_device( aws_device_t::BME_SENSOR ) )
-		initialise_BME();
+	if ( !i2c_bus.lock( job.address, i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS )) {
 
-	if ( config->get_has_device( aws_device_t::MLX_SENSOR ) )
-		initialise_MLX();
+		Serial.printf( "[SENSORMNGR] [ERROR] Could not get the I2C bus to initialise %s.\n", job.name );
+		return;
+	}
 
-	if ( config->get_has_device( aws_device_t::TSL_SENSOR ) ) {
+	( this->*job.initialise )();
+	i2c_bus.unlock( job.address, sensor_is_available( job.sensor ));
+}
 
-		initialise_TSL();
-		sqm.initialise( &tsl, &sensor_data.sqm, config->get_parameter<float>( "msas_calibration_offset" ), debug_mode );
+void AWSSensorManager::initialise_sensors( void )
+{
+	if ( sensor_cache.magic != SENSOR_CACHE_MAGIC ) {
+
+		sensor_cache.present_sensors = aws_device_t::NO_SENSOR;
+		sensor_cache.magic = SENSOR_CACHE_MAGIC;
 	}
 
-	initialise_dbmeter();
+	// The dB meter is always probed
+	for ( sensor_job_t &job : sensor_jobs )
+		if ( config->get_has_device( job.sensor ) || ( job.sensor == aws_device_t::SPL_SENSOR ))
+			initialise_sensor( job );
+
+	if ( config->get_has_device( aws_device_t::TSL_SENSOR ) )
+		sqm.initialise( &tsl, &sqm_reading, config->get_compiled_config().msas_calibration_offset, 1000UL * config->get_compiled_config().sqm_max_exposure, debug_mode );
+
+	publish_sensor_data();
 }
 
 void AWSSensorManager::initialise_TSL( void )
@@ -244,56 +322,72 @@ void AWSSensorManager::initialise_TSL( void )
 	}
 }
 
-bool AWSSensorManager::poll_sensors( void )
+// Concurrent publishers (acquisition, availability updates) are serialised by publish_mux
+void AWSSensorManager::publish_sensor_data( void )
 {
-	if ( xSemaphoreTake( sensors_read_mutex, 2000 / portTICK_PERIOD_MS ) == pdTRUE ) {
+	portENTER_CRITICAL( &publish_mux );
 
-		retrieve_sensor_data();
-		xSemaphoreGive( sensors_read_mutex );
-		return true;
-	}
-	return false;
-}
+	uint32_t sequence = publish_sequence.load( std::memory_order_relaxed );
 
-void AWSSensorManager::poll_sensors_task( void *dummy )	// NOSONAR
-{
-	while( true ) {
+	publish_sequence.store( sequence + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	memcpy( &published_sensor_data, &sensor_data, sizeof( sensor_data_t ));
+	publish_sequence.store( sequence + 2, std::memory_order_release );
 
-		if ( xSemaphoreTake( sensors_read_mutex, 5000 / portTICK_PERIOD_MS ) == pdTRUE ) {
-
-			retrieve_sensor_data();
-			xSemaphoreGive( sensors_read_mutex );
-		}
-		delay( polling_ms_interval );
-	}
+	portEXIT_CRITICAL( &publish_mux );
 }
 
-void AWSSensorManager::read_dbmeter( void  )
+// The first call starts an integration, the next ones poll it. Returns the delay before the next call, 0 once the level is known.
+uint32_t AWSSensorManager::read_dbmeter( void  )
 {
 	if ( ( sensor_data.available_sensors & aws_device_t::SPL_SENSOR ) == aws_device_t::SPL_SENSOR ) {
 
-		sensor_data.db = spl.read();
+		uint32_t wait_ms;
+
+		if (( wait_ms = spl.is_integrating() ? spl.poll() : spl.start() ))
+			return wait_ms;
+
+		// The meter never reads 0dB, failed reads do
+		if ( !( sensor_data.db = spl.collect() ))
+			read_failed( aws_device_t::SPL_SENSOR );
+		spl.get_noise_indices( sensor_data.noise );
 		if ( debug_mode )
-			Serial.printf( "[SENSORMNGR] [DEBUG] SPL = %ddB\n", sensor_data.db  );
-		return;
+			Serial.printf( "[SENSORMNGR] [DEBUG] SPL = %ddB, Leq = %.1fdB, L10/L50/L90 = %d/%d/%ddB, Lmax = %ddB over %d samples\n", sensor_data.db, sensor_data.noise.leq, sensor_data.noise.l10, sensor_data.noise.l50, sensor_data.noise.l90, sensor_data.noise.lmax, sensor_data.noise.samples );
+		return 0;
 	}
 	sensor_data.db = 0;
+	return 0;
 }
 
-void AWSSensorManager::read_BME( void  )
+// The first call triggers a forced conversion, the bus is released while it runs and the next call reads the results.
+uint32_t AWSSensorManager::read_BME( void  )
 {
 	if ( ( sensor_data.available_sensors & aws_device_t::BME_SENSOR ) == aws_device_t::BME_SENSOR ) {
 
-		sensor_data.weather.temperature = bme.readTemperature();
-		sensor_data.weather.pressure = bme.readPressure() / 100.F;
-		sensor_data.weather.rh = bme.readHumidity();
+		if ( !bme.is_converting() )
+			return bme.start();
+
+		if ( !bme.read( sensor_data.weather.temperature, sensor_data.weather.pressure, sensor_data.weather.rh )) {
 
-		// "Arden Buck" equation
-		float gammaM = log( ( sensor_data.weather.rh / 100 )*exp( ( 18.68 - sensor_data.weather.temperature / 234.5 ) * ( sensor_data.weather.temperature / ( 257.14 + sensor_data.weather.temperature )) ));
-		if ( sensor_data.weather.temperature >= 0 )
-			sensor_data.weather.dew_point = ( 238.88 * gammaM ) / ( 17.368 - gammaM );
+			Serial.printf( "[SENSORMNGR] [ERROR] Could not read BME280.\n" );
+			read_failed( aws_device_t::BME_SENSOR );
+			sensor_data.weather.temperature = -99.F;
+			sensor_data.weather.pressure = 0.F;
+			sensor_data.weather.rh = 0.F;
+			sensor_data.weather.dew_point = -99.F;
+			return 0;
+		}
+		sensor_data.weather.pressure /= 100.F;
+
+		// "Arden Buck" equation, log( rh*exp( x )) expanded to log( rh ) + x
+		float t = sensor_data.weather.temperature;
+		float gammaM = fast_logf( sensor_data.weather.rh / 100.F ) + ( 18.68F - t / 234.5F ) * ( t / ( 257.14F + t ));
+		if ( sensor_data.weather.rh <= 0 )
+			sensor_data.weather.dew_point = -99.F;
+		else if ( t >= 0 )
+			sensor_data.weather.dew_point = ( 238.88F * gammaM ) / ( 17.368F - gammaM );
 		else
-			sensor_data.weather.dew_point = ( 247.15 * gammaM ) / ( 17.966 - gammaM );
+			sensor_data.weather.dew_point = ( 247.15F * gammaM ) / ( 17.966F - gammaM );
 
 		if ( debug_mode ) {
 
@@ -302,30 +396,38 @@ void AWSSensorManager::read_BME( void  )
 			Serial.printf( "[SENSORMNGR] [DEBUG] RH = %3.2f %%\n", sensor_data.weather.rh );
 			Serial.printf( "[SENSORMNGR] [DEBUG] Dew point = %2.2f °C\n", sensor_data.weather.dew_point );
 		}
-		return;
+		return 0;
 	}
 
 	sensor_data.weather.temperature = -99.F;
 	sensor_data.weather.pressure = 0.F;
 	sensor_data.weather.rh = 0.F;
 	sensor_data.weather.dew_point = -99.F;
+	return 0;
 }
 
-void AWSSensorManager::read_MLX( void )
+uint32_t AWSSensorManager::read_MLX( void )
 {
 	if ( ( sensor_data.available_sensors & aws_device_t::MLX_SENSOR ) == aws_device_t::MLX_SENSOR ) {
 
+		const compiled_config_t	&cfg	= config->get_compiled_config();
+		const std::array<int,7>	&k		= cfg.k;
+
 		sensor_data.weather.ambient_temperature = mlx.readAmbientTempC();
 		sensor_data.weather.sky_temperature = mlx.readObjectTempC();
 		sensor_data.weather.raw_sky_temperature = mlx.readObjectTempC();
 
-		if ( config->get_parameter<int>( "cloud_coverage_formula" ) == 0 ) {
+		// The driver returns a raw 0 (-273.15°C) when the transaction fails
+		if (( sensor_data.weather.ambient_temperature < -273.F ) || ( sensor_data.weather.raw_sky_temperature < -273.F ))
+			read_failed( aws_device_t::MLX_SENSOR );
+
+		if ( cfg.cloud_coverage_formula == 0 ) {
 
 			sensor_data.weather.sky_temperature -= sensor_data.weather.ambient_temperature;
 			sensor_data.weather.cloud_coverage = ( sensor_data.weather.sky_temperature <= -15 ) ? 0 : 2;
-			if ( sensor_data.weather.sky_temperature < config->get_parameter<int>( "cc_aws_cloudy" ) )
+			if ( sensor_data.weather.sky_temperature < cfg.cc_aws_cloudy )
 				sensor_data.weather.cloud_coverage = static_cast<uint8_t>( cloud_coverage::CLEAR );
-			else if ( sensor_data.weather.sky_temperature < config->get_parameter<int>( "cc_aws_overcast" ) )
+			else if ( sensor_data.weather.sky_temperature < cfg.cc_aws_overcast )
 				sensor_data.weather.cloud_coverage = static_cast<uint8_t>( cloud_coverage::CLOUDY );
 			else
 				sensor_data.weather.cloud_coverage = static_cast<uint8_t>( cloud_coverage::OVERCAST );
@@ -333,18 +435,22 @@ void AWSSensorManager::read_MLX( void )
 		}
 		else {
 
-			float t = ( k[0] / 100 ) * ( sensor_data.weather.ambient_temperature - k[1] / 10 ) * ( k[2] / 100 ) * pow( exp( k[3] / 1000 * sensor_data.weather.ambient_temperature ), k[4]/100 );
+			// AAG CloudWatcher correction, the coefficients are stored as integers (K1 * 100, K2 * 10, ...)
+			// pow( exp( K4/1000 * Ta ), K5/100 ) is folded into a single exp
+			float ta = sensor_data.weather.ambient_temperature;
+			float k2 = k[1] / 10.F;
+			float t = ( k[0] / 100.F ) * ( ta - k2 ) + ( k[2] / 100.F ) * fast_expf( k[3] / 1000.F * k[4] / 100.F * ta );
 			float t67;
-			if ( abs( k[1] / 10 - sensor_data.weather.ambient_temperature ) < 1 )
-				t67 = sign<int>( k[5] ) * sign<float>( sensor_data.weather.ambient_temperature - k[1]/10) * ( k[1] / 10 - sensor_data.weather.ambient_temperature );
+			if ( fabsf( k2 - ta ) < 1 )
+				t67 = sign<int>( k[5] ) * sign<float>( ta - k2 ) * fabsf( k2 - ta );
 			else
-				t67 = k[5] / 10 * sign( sensor_data.weather.ambient_temperature - k[1]/10 ) * ( log( abs( k[1]/10 - sensor_data.weather.ambient_temperature ))/log(10) + k[6] / 100 );
+				t67 = k[5] / 10.F * sign<float>( ta - k2 ) * ( fast_log10f( fabsf( k2 - ta )) + k[6] / 100.F );
 			t += t67;
 			sensor_data.weather.sky_temperature -= t;
 
-			if ( sensor_data.weather.sky_temperature < config->get_parameter<int>( "cc_aag_cloudy" ) )
+			if ( sensor_data.weather.sky_temperature < cfg.cc_aag_cloudy )
 				sensor_data.weather.cloud_coverage = static_cast<uint8_t>( cloud_coverage::CLEAR );
-			else if ( sensor_data.weather.sky_temperature < config->get_parameter<int>( "cc_aag_overcast" ) )
+			else if ( sensor_data.weather.sky_temperature < cfg.cc_aag_overcast )
 				sensor_data.weather.cloud_coverage = static_cast<uint8_t>( cloud_coverage::CLOUDY );
 			else
 				sensor_data.weather.cloud_coverage = static_cast<uint8_t>( cloud_coverage::OVERCAST );
@@ -352,103 +458,209 @@ void AWSSensorManager::read_MLX( void )
 		}
 		if ( debug_mode )
 			Serial.printf( "[SENSORMNGR] [DEBUG] Ambient temperature = %2.2f °C / Raw sky temperature = %2.2f °C / Corrected sky temperature = %2.2f / Cloud coverage = %s (%d)\n", sensor_data.weather.ambient_temperature, sensor_data.weather.raw_sky_temperature, sensor_data.weather.sky_temperature, CLOUD_COVERAGE_STR[sensor_data.weather.cloud_coverage].data(), sensor_data.weather.cloud_coverage );
-		return;
+		return 0;
 	}
 	sensor_data.weather.ambient_temperature = -99.F;
 	sensor_data.weather.raw_sky_temperature = -99.F;
 	sensor_data.weather.sky_temperature = -99.F;
+	return 0;
 }
 
 void AWSSensorManager::read_sensors( void )
 {
 	retrieve_sensor_data();
 
-	if ( prev_available_sensors != sensor_data.available_sensors ) {
-
-		prev_available_sensors = static_cast<unsigned long>( sensor_data.available_sensors );
+	if ( availability_changed() )
 		station.report_unavailable_sensors();
-	}
 }
 
-void AWSSensorManager::read_TSL( void )
+// Called by the read functions, the health of the sensor is updated once its reading is complete
+void AWSSensorManager::read_failed( aws_device_t sensor )
+{
+	forget_sensor( sensor );
+
+	for ( sensor_job_t &job : sensor_jobs )
+		if ( job.sensor == sensor )
+			job.health.read_failed = true;
+}
+
+//
+// Lux, irradiance and MPSAS come from one auto-ranged exposure. It is taken without holding the bus, which the SQM
+// engine takes for each exposure only, the results are then published in one go.
+//
+uint32_t AWSSensorManager::read_TSL( void )
 {
-	int			lux = -1;
+	int		lux				= -1;
+	bool	long_exposure	= false;
+	bool	answered		= true;
 
 	if ( ( sensor_data.available_sensors & aws_device_t::TSL_SENSOR ) == aws_device_t::TSL_SENSOR ) {
 
-		uint32_t lum = tsl.getFullLuminosity();
-		uint16_t ir = lum >> 16;
-		uint16_t full = lum & 0xFFFF;
-		lux = tsl.calculateLux( full, ir );
+		long_exposure = long_exposure_is_due();
+		sqm.read( sensor_data.weather.ambient_temperature, long_exposure );
+		lux = ( sqm_reading.lux < 0 ) ? -1 : static_cast<int>( sqm_reading.lux );
 
 		if ( debug_mode )
-			Serial.printf( "[SENSORMNGR] [DEBUG] Infrared=%05d Full=%05d Visible=%05d Lux = %05d\n", ir, full, full - ir, lux );
+			Serial.printf( "[SENSORMNGR] [DEBUG] Infrared=%05d Full=%05d Lux = %05d\n", sqm_reading.ir_luminosity, sqm_reading.full_luminosity, lux );
+	}
+
+	if ( sqm_reading.exposure_ms > SQM_INTEGRATION_TIME[ TSL2591_INTEGRATIONTIME_600MS ] )
+		last_long_exposure_ms = millis();
+
+	i2c_bus.lock( TSL2591_ADDR, i2c_priority_t::NORMAL, I2C_NO_TIMEOUT );
+
+	// The driver does not report failed transactions, make sure the sensor is still there
+	if ( sensor_is_available( aws_device_t::TSL_SENSOR )) {
+
+		Wire.beginTransmission( TSL2591_ADDR );
+		if ( !( answered = ( Wire.endTransmission() == 0 )))
+			read_failed( aws_device_t::TSL_SENSOR );
 	}
 
 	// Avoid aberrant readings
 	sensor_data.sun.lux = ( lux < TSL_MAX_LUX ) ? lux : -1;
-	sensor_data.sun.irradiance = ( lux == -1 ) ? 0 : lux * LUX_TO_IRRADIANCE_FACTOR;
+	sensor_data.sun.irradiance = ( sensor_data.sun.lux == -1 ) ? 0 : sensor_data.sun.lux * LUX_TO_IRRADIANCE_FACTOR;
+	if (( sensor_data.sun.lux >= 0 ) && ( sensor_data.sun.lux < SQM_MAX_LUX ))
+		sensor_data.sqm = sqm_reading;
+	time( &sensor_data.timestamp );
+	publish_sensor_data();
+
+	i2c_bus.unlock( TSL2591_ADDR, answered );
+	return 0;
 }
 
-void AWSSensorManager::encode_sensor_data( void )
+void AWSSensorManager::retrieve_sensor_data( void )
 {
-	if ( debug_mode )
-		Serial.printf( "[SENSORMNGR] [DEBUG] Compact sensor data format version: %02x\n", compact_data->format_version );
+	WAKE_TRACE( wake_phase_t::SENSORS );
 
-	compact_data->timestamp = sensor_data.timestamp;
+	for ( sensor_job_t &job : sensor_jobs )
+		if ( config->get_has_device( job.sensor ))
+			run_sensor_job( job );
+}
 
-	compact_data->lux = float_to_int32_encode( sensor_data.sun.lux, 0, 80000 );
-	compact_data->irradiance = float_to_int16_encode( sensor_data.sun.irradiance, 0, 1000 );
+// Initialises a degraded sensor again once its backoff delay is over
+void AWSSensorManager::retry_sensor( sensor_job_t &job )
+{
+	sensor_health_t &health = job.health;
 
-	compact_data->temperature = float_to_int16_encode( sensor_data.weather.temperature, -40, 50 );
-	compact_data->pressure = float_to_int32_encode( sensor_data.weather.pressure, 700, 1050 );
-	compact_data->rh = float_to_int16_encode( sensor_data.weather.rh, 0, 100 );
+	if ( static_cast<int32_t>( millis() - health.next_retry_ms ) < 0 )
+		return;
+
+	if ( !i2c_bus.lock( job.address, i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS ))
+		return;
 
-	compact_data->ambient_temperature = float_to_int16_encode( sensor_data.weather.ambient_temperature, -40, 50 );
-	compact_data->raw_sky_temperature = float_to_int16_encode( sensor_data.weather.raw_sky_temperature, -100, 50 );
-	compact_data->sky_temperature = float_to_int16_encode( sensor_data.weather.sky_temperature, -100, 50 );
-	compact_data->cloud_cover = float_to_int16_encode( sensor_data.weather.cloud_cover, -100, 50 );
-	compact_data->cloud_coverage = sensor_data.weather.cloud_coverage;
+	( this->*job.initialise )();
+	if ( sensor_is_available( job.sensor ))
+		publish_sensor_data();
+	i2c_bus.unlock( job.address, sensor_is_available( job.sensor ));
 
-	compact_data->msas = float_to_int16_encode( sensor_data.sqm.msas, 0, 30);
-	compact_data->nelm = float_to_int16_encode( sensor_data.sqm.nelm, -15, 10 );
+	if ( sensor_is_available( job.sensor )) {
 
-	compact_data->db = sensor_data.db;
+		Serial.printf( "[SENSORMNGR] [INFO ] %s is back.\n", job.name );
+		health.state = sensor_health_state_t::HEALTHY;
+		health.errors = 0;
+		job.stats.recoveries++;
+		return;
+	}
 
-	compact_data->available_sensors = sensor_data.available_sensors;
+	health.retry_ms = std::min( 2 * health.retry_ms, SENSOR_RETRY_MAX_MS );
+	health.next_retry_ms = millis() + health.retry_ms;
+	Serial.printf( "[SENSORMNGR] [ERROR] %s is still not responding, next attempt in %ds.\n", job.name, health.retry_ms / 1000 );
 }
 
-void AWSSensorManager::retrieve_sensor_data( void )
+//
+// Reads one sensor, holding the bus only for its own transactions. Sensors that integrate over time (dB meter) ask
+// to be called again later: the bus is released while they integrate.
+//
+bool AWSSensorManager::run_sensor_job( sensor_job_t &job )
 {
-	if ( xSemaphoreTake( i2c_mutex, 500 / portTICK_PERIOD_MS ) == pdTRUE ) {
-
-		time( &sensor_data.timestamp );
+	uint32_t wait_ms;
 
-		if ( config->get_has_device( aws_device_t:: BME_SENSOR ) )
-			read_BME();
+	job.health.read_failed = false;
+	if ( job.takes_bus ) {
 
+		( this->*job.read )();
 		esp_task_wdt_reset();
+		return true;
+	}
 
-		if ( config->get_has_device( aws_device_t::MLX_SENSOR ) )
-			read_MLX();
+	do {
 
-		esp_task_wdt_reset();
+		if ( !i2c_bus.lock( job.address, i2c_priority_t::NORMAL, I2C_LOCK_TIMEOUT_MS ))
+			return false;
 
-		if ( config->get_has_device( aws_device_t::TSL_SENSOR ) ) {
+		if ( !( wait_ms = ( this->*job.read )() )) {
 
-			read_TSL();
-			if ( ( sensor_data.available_sensors & aws_device_t::TSL_SENSOR ) == aws_device_t::TSL_SENSOR )
-				sqm.read( sensor_data.weather.ambient_temperature );
+			time( &sensor_data.timestamp );
+			publish_sensor_data();
 		}
+		i2c_bus.unlock( job.address, !job.health.read_failed );
 
-		esp_task_wdt_reset();
+		if ( wait_ms )
+			delay( wait_ms );
 
-		read_dbmeter();
+	} while ( wait_ms );
 
-		esp_task_wdt_reset();
+	esp_task_wdt_reset();
+	return true;
+}
+
+//
+// Runs a sensor at a fixed rate: the next deadline is one period after the previous one, not after the end of the read.
+// If the read overran a full period, the schedule restarts from now instead of trying to catch up.
+//
+void AWSSensorManager::sensor_job_task( sensor_job_t &job )
+{
+	sensor_job_stats_t	&stats		= job.stats;
+	uint32_t			deadline	= millis();
+	uint32_t			last_start	= 0;
+	int32_t				wait_ms;
+
+	// Moving average over roughly the last 8 runs
+	auto average = []( uint32_t avg, uint32_t value ) {
+		return static_cast<uint32_t>( static_cast<int32_t>( avg ) + ( static_cast<int32_t>( value ) - static_cast<int32_t>( avg )) / 8 );
+	};
+
+	while ( true ) {
+
+		uint32_t start	= millis();
+		uint32_t jitter	= start - deadline;
+
+		stats.interval_ms = stats.runs ? average( stats.interval_ms, start - last_start ) : stats.period_ms;
+		stats.avg_jitter_ms = stats.runs ? average( stats.avg_jitter_ms, jitter ) : jitter;
+		if ( jitter > stats.max_jitter_ms )
+			stats.max_jitter_ms = jitter;
+		last_start = start;
+
+		if ( job.health.state == sensor_health_state_t::DEGRADED )
+			retry_sensor( job );
+
+		else {
+
+			bool done;
 
-		xSemaphoreGive( i2c_mutex );
+			if ( !( done = run_sensor_job( job ))) {
 
+				Serial.printf( "[SENSORMNGR] [ERROR] Could not get the I2C bus to read %s.\n", job.name );
+				stats.misses++;
+			}
+			stats.runs++;
+			update_sensor_health( job, done && !job.health.read_failed );
+		}
+
+		if ( debug_mode )
+			Serial.printf( "[SENSORMNGR] [DEBUG] %s: period=%dms interval=%dms jitter=%dms (avg=%dms max=%dms) missed=%d\n", job.name, stats.period_ms, stats.interval_ms, jitter, stats.avg_jitter_ms, stats.max_jitter_ms, stats.misses );
+
+		deadline += stats.period_ms;
+		wait_ms = static_cast<int32_t>( deadline - millis() );
+
+		if ( wait_ms > 0 )
+			delay( wait_ms );
+		else if ( static_cast<uint32_t>( -wait_ms ) >= stats.period_ms ) {
+
+			stats.misses++;
+			deadline = millis();
+		}
 	}
 }
 
@@ -471,8 +683,12 @@ void AWSSensorManager::set_solar_panel( bool b )
 
 void AWSSensorManager::resume( void )
 {
-	if ( initialised )
-		vTaskResume( sensors_task_handle );
+	if ( !initialised )
+		return;
+
+	for ( sensor_job_t &job : sensor_jobs )
+		if ( job.task_handle )
+			vTaskResume( job.task_handle );
 }
 
 bool AWSSensorManager::sensor_is_available( aws_device_t sensor )
@@ -480,16 +696,98 @@ bool AWSSensorManager::sensor_is_available( aws_device_t sensor )
 	return (( sensor_data.available_sensors & sensor ) == sensor );
 }
 
+// Only the BME280 and the dB meter have a warm initialisation, the other drivers keep their own state private
+bool AWSSensorManager::sensor_is_cached( aws_device_t sensor )
+{
+	return ( sensor_cache.magic == SENSOR_CACHE_MAGIC ) && (( sensor_cache.present_sensors & sensor ) == sensor );
+}
+
+// SQM only makes sense at night, DC powered stations also limit it to one reading every sqm_period
+// Long exposures only happen on dark skies anyway, but they can take up to sqm_max_exposure: limit them to one per sqm_period
+bool AWSSensorManager::long_exposure_is_due( void )
+{
+	return solar_panel || !last_long_exposure_ms || (( millis() - last_long_exposure_ms ) >= 1000UL * config->get_compiled_config().sqm_period );
+}
+
+void AWSSensorManager::start_sensor_jobs( void )
+{
+	const compiled_config_t							&cfg	= config->get_compiled_config();
+	const std::array<uint16_t, SENSOR_JOB_COUNT>	period	= { cfg.bme_period, cfg.mlx_period, cfg.tsl_period, cfg.spl_period };
+
+	for ( uint8_t i = 0; i < SENSOR_JOB_COUNT; i++ ) {
+
+		sensor_job_t &job = sensor_jobs[ i ];
+
+		if ( job.task_handle || !config->get_has_device( job.sensor ))
+			continue;
+
+		job.stats.period_ms = 1000UL * std::max<uint16_t>( period[ i ], 1 );
+
+		// Not found at boot: keep looking for it
+		if ( !sensor_is_available( job.sensor )) {
+
+			job.health.state = sensor_health_state_t::DEGRADED;
+			job.health.retry_ms = SENSOR_RETRY_MIN_MS;
+			job.health.next_retry_ms = millis() + job.health.retry_ms;
+		}
+		xTaskCreatePinnedToCore(
+			[]( void *param ) {	// NOSONAR
+				auto *_job = static_cast<sensor_job_t *>( param );
+				_job->manager->sensor_job_task( *_job );
+			}, job.name, SENSOR_JOB_STACK_SIZE, &job, 5, &job.task_handle, 1 );
+	}
+}
+
 void AWSSensorManager::suspend( void )
 {
-	if ( initialised )
-		vTaskSuspend( sensors_task_handle );
+	if ( !initialised )
+		return;
+
+	for ( sensor_job_t &job : sensor_jobs )
+		if ( job.task_handle )
+			vTaskSuspend( job.task_handle );
 }
 
+// Called by the station as well: sensor_data is only written while holding the bus, like the sensor jobs do
 void AWSSensorManager::update_available_sensors( aws_device_t dev, bool is_available )
 {
+	i2c_bus.lock( I2C_NO_DEVICE, i2c_priority_t::NORMAL, I2C_NO_TIMEOUT );
+
 	if ( is_available )
 		sensor_data.available_sensors |= dev;
 	else
 		sensor_data.available_sensors &= ~dev;
+	publish_sensor_data();
+
+	i2c_bus.unlock( I2C_NO_DEVICE, true );
+}
+
+//
+// After SENSOR_MAX_ERRORS consecutive failed reads the sensor is marked unavailable, which the station reports,
+// and its initialisation is retried with an exponential backoff instead of reading it.
+//
+void AWSSensorManager::update_sensor_health( sensor_job_t &job, bool ok )
+{
+	sensor_health_t &health = job.health;
+
+	if ( ok ) {
+
+		health.errors = 0;
+		return;
+	}
+
+	job.stats.errors++;
+	if ( ++health.errors < SENSOR_MAX_ERRORS )
+		return;
+
+	health.state = sensor_health_state_t::DEGRADED;
+	health.retry_ms = SENSOR_RETRY_MIN_MS;
+	health.next_retry_ms = millis() + health.retry_ms;
+	Serial.printf( "[SENSORMNGR] [ERROR] %s failed %d times in a row, taken out until it can be initialised again (first attempt in %ds).\n", job.name, health.errors, health.retry_ms / 1000 );
+
+	forget_sensor( job.sensor );
+	update_available_sensors( job.sensor, false );
+
+	// Publishes the values of a missing sensor instead of the last reading
+	run_sensor_job( job );
 }
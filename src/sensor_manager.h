@@ -21,20 +21,66 @@
 #ifndef _sensor_manager_H
 #define _sensor_manager_H
 
-#include <Adafruit_BME280.h>
 #include <Adafruit_MLX90614.h>
 #include "Adafruit_TSL2591.h"
 #include <Preferences.h>
 #include <ArduinoJson.h>
+#include <atomic>
 
 #include "defaults.h"
+#include "bme280.h"
 #include "dbmeter.h"
 #include "config_manager.h"
+#include "i2c_bus.h"
 #include "SQM.h"
 #include "device.h"
 
 const float			LUX_TO_IRRADIANCE_FACTOR	= 0.88;
 const unsigned int	TSL_MAX_LUX					= 88000;
+const int			SQM_MAX_LUX					= 10;		// MPSAS is only reported below this illuminance (~civil dusk)
+const uint8_t		SENSOR_JOB_COUNT			= 4;
+const uint32_t		SENSOR_JOB_STACK_SIZE		= 6144;
+const uint32_t		SENSOR_CACHE_MAGIC			= 0x5E45CA5E;
+const uint8_t		SENSOR_MAX_ERRORS			= 3;		// Consecutive failed reads before a sensor is taken out and initialised again
+const uint32_t		SENSOR_RETRY_MIN_MS			= 30000;	// First re-initialisation delay, doubled after each failed attempt
+const uint32_t		SENSOR_RETRY_MAX_MS			= 3600000;
+
+// Devices found at the last initialisation and their driver state, kept in RTC memory so that wakes do not probe them again
+struct sensor_cache_t {
+
+	uint32_t			magic;
+	aws_device_t		present_sensors;		// A device is dropped from the map when a read fails, the next initialisation probes it
+	bme280_calib_data	bme_calibration;
+	dbm_identity_t		dbm_identity;
+};
+
+// Achieved acquisition rate of a sensor, all durations in ms
+struct sensor_job_stats_t {
+
+	uint32_t	period_ms;
+	uint32_t	runs;
+	uint32_t	misses;			// Runs that started a full period late or could not get the bus
+	uint32_t	interval_ms;	// Moving average of the time between two runs
+	uint32_t	avg_jitter_ms;	// Moving average of the start delay against the deadline
+	uint32_t	max_jitter_ms;
+	uint32_t	errors;			// Failed reads, including bus timeouts
+	uint32_t	recoveries;		// Successful re-initialisations after the sensor was taken out
+};
+
+enum struct sensor_health_state_t : uint8_t {
+
+	HEALTHY,
+	DEGRADED		// Not read, its initialisation is retried with an exponential backoff
+};
+
+struct sensor_health_t {
+
+	sensor_health_state_t	state;
+	bool					read_failed;	// Set by the read function
+	uint8_t					errors;			// Consecutive
+	uint32_t				retry_ms;
+	uint32_t				next_retry_ms;
+};
 
 enum struct cloud_coverage : uint8_t {
 
@@ -48,42 +94,59 @@ class AWSSensorManager {
 
 	private:
 
-		Adafruit_BME280		bme;
+		// Each sensor is read by its own task, at its own period, so that long acquisitions do not delay the others
+		struct sensor_job_t {
+
+			aws_device_t		sensor;
+			const char			*name;
+			uint8_t				address;								// On the I2C bus
+			uint32_t			( AWSSensorManager::*read )( void );	// Returns 0 when done, or the delay before it must be called again
+			void				( AWSSensorManager::*initialise )( void );	// Sets the sensor available if found
+			bool				takes_bus;								// The read takes the bus for each transaction and publishes its results itself
+			AWSSensorManager	*manager;
+			TaskHandle_t		task_handle;
+			sensor_job_stats_t	stats;
+			sensor_health_t		health;
+		};
+
+		bme280				bme;
 		Adafruit_MLX90614	mlx;
 		Adafruit_TSL2591	tsl;
 		dbmeter				spl;
 		SQM					sqm;
-		std::array<int,7>	k;
 		AWSConfig 			*config	= nullptr;
 
-		compact_data_t			*compact_data		= nullptr;
-		sensor_data_t			sensor_data;
+		sensor_data_t			sensor_data;			// Written while holding the I2C bus: sensor jobs, initialisation, availability updates
+		sensor_data_t			published_sensor_data;	// Last complete acquisition, read through get_sensor_snapshot()
+		std::atomic<uint32_t>	publish_sequence{ 0 };	// Odd while published_sensor_data is being written
+		portMUX_TYPE			publish_mux			= portMUX_INITIALIZER_UNLOCKED;
 		bool					debug_mode			= false;
 		bool					initialised			= false;
 		bool					solar_panel			= false;
-		TaskHandle_t			sensors_task_handle;
-		SemaphoreHandle_t		i2c_mutex			= nullptr;
-		uint32_t				polling_ms_interval	= DEFAULT_SENSOR_POLLING_MS_INTERVAL;
+		uint32_t				last_long_exposure_ms	= 0;
+		sqm_data_t				sqm_reading;
+		std::array<sensor_job_t, SENSOR_JOB_COUNT>	sensor_jobs;
 
 	public:
     							AWSSensorManager( void );
 		bool					begin( void );
-		int16_t					float_to_int16_encode( float, float, float );
-		int32_t					float_to_int32_encode( float, float, float );
+		bool					availability_changed( void );
+		void					close_noise_interval( void );
 		aws_device_t			get_available_sensors( void );
+		uint32_t				get_data_generation( void );
 		bool					get_debug_mode( void );
-		SemaphoreHandle_t		get_i2c_mutex( void );
 		sensor_data_t			*get_sensor_data( void );
-		bool					initialise( AWSConfig *, compact_data_t *, bool );
+		const char				*get_sensor_job_name( uint8_t );
+		bool					get_sensor_job_stats( uint8_t, sensor_job_stats_t & );
+		uint32_t				get_sensor_snapshot( sensor_data_t & );
+		bool					initialise( AWSConfig *, bool );
 		void					initialise_sensors( void );
-		bool					poll_sensors( void );
 		void					read_sensors( void );
 		void					resume( void );
 		bool					sensor_is_available( aws_device_t );
 		void					update_available_sensors( aws_device_t, bool );
 		void					set_debug_mode( bool );
 		void					set_solar_panel( bool );
-		void					encode_sensor_data( void );
 		void					suspend( void );
 
 	private:
@@ -93,13 +156,23 @@ class AWSSensorManager {
 		void	initialise_dbmeter( void );
 		void	initialise_BME( void );
 		void	initialise_MLX( void );
+		void	initialise_sensor( sensor_job_t & );
 		void	initialise_TSL( void );
-		void	poll_sensors_task( void * );
-		void	read_dbmeter( void );
-		void	read_BME( void );
-		void	read_MLX( void );
-		void	read_TSL( void );
+		void	forget_sensor( aws_device_t );
+		void	read_failed( aws_device_t );
+		void	retry_sensor( sensor_job_t & );
+		void	update_sensor_health( sensor_job_t &, bool );
+		bool	sensor_is_cached( aws_device_t );
+		void	publish_sensor_data( void );
+		uint32_t	read_dbmeter( void );
+		uint32_t	read_BME( void );
+		uint32_t	read_MLX( void );
+		uint32_t	read_TSL( void );
 		void	retrieve_sensor_data( void );
+		bool	run_sensor_job( sensor_job_t & );
+		void	sensor_job_task( sensor_job_t & );
+		bool	long_exposure_is_due( void );
+		void	start_sensor_jobs( void );
 };
 
 #endif
@@ -0,0 +1,144 @@
+/*
+  	sqm_ranging.h
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//
+// TSL2591 settings, auto-ranging ladder and warm start prediction of the SQM.
+// This header only depends on the C++ standard library so that it can be compiled and checked on a host.
+// Gains and integration times are the register values of the TSL2591 (gain index << 4, integration time index).
+//
+
+#pragma once
+#ifndef _sqm_ranging_H
+#define _sqm_ranging_H
+
+#include <array>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+
+const std::array<uint16_t,4>	SQM_GAIN_FACTOR				= { 1, 25, 428, 9876 };
+const std::array<uint16_t,6>	SQM_INTEGRATION_TIME		= { 100, 200, 300, 400, 500, 600 };
+const uint8_t					SQM_MAX_GAIN				= 0x30;
+const uint8_t					SQM_MAX_INTEGRATION_TIME	= 0x05;
+const time_t					SQM_WARM_START_MAX_AGE		= 3600;		// in seconds, older settings are not used to predict the next one
+const float						SQM_PREDICTED_MAX_FULL		= 32768;	// Predicted counts are kept below half scale to allow for brightening
+const float						SQM_PREDICTED_MIN_VISIBLE	= 256;		// and above twice the minimum accepted by get_msas_nelm()
+const uint16_t					SQM_MIN_VISIBLE				= 128;
+const uint16_t					SQM_MAX_COUNT_100MS			= 36863;	// ADC full scale at 100ms, 65535 for longer integration times
+const uint32_t					SQM_ADC_STEP_MS				= 120;		// Wait per 100ms of integration time, with the driver's margin
+const float						SQM_TARGET_SNR				= 20;		// Long exposures stop once reached, ~0.05 mag
+const uint16_t					SQM_MAX_FRAMES				= 1000;
+const uint8_t					SQM_MAX_SETTINGS			= 16;		// Auto-ranging gives up after trying that many settings
+
+// Last converged setting, kept in RTC memory so that the next reading does not start from the lowest range
+struct sqm_warm_start_t {
+
+	time_t		timestamp;
+	uint8_t		gain;
+	uint8_t		integration_time;
+	uint32_t	full_luminosity;		// Per exposure, temperature compensated
+	uint32_t	visible_luminosity;		// Per exposure, temperature compensated
+};
+
+// Time taken by one exposure
+inline uint32_t sqm_frame_ms( uint8_t integration_time )
+{
+	return SQM_ADC_STEP_MS * ( integration_time + 1U );
+}
+
+// Checked on the raw counts of both channels, before temperature compensation
+inline bool sqm_saturated( uint8_t integration_time, uint32_t full, uint32_t ir )
+{
+	uint32_t max_count = integration_time ? UINT16_MAX : SQM_MAX_COUNT_100MS;
+
+	return ( full >= max_count ) || ( ir >= max_count );
+}
+
+// Next setting up the ladder: integration time is increased before gain to keep the noise down. Returns false at the top.
+inline bool sqm_more_exposure( uint8_t *gain, uint8_t *integration_time )
+{
+	if ( *integration_time < SQM_MAX_INTEGRATION_TIME ) {
+
+		( *integration_time )++;
+		return true;
+	}
+	if ( *gain < SQM_MAX_GAIN ) {
+
+		*gain += 0x10;
+		return true;
+	}
+	return false;
+}
+
+// Next setting down the ladder: gain is decreased first, for the same reason. Returns false at the bottom.
+inline bool sqm_less_exposure( uint8_t *gain, uint8_t *integration_time )
+{
+	if ( *gain ) {
+
+		*gain -= 0x10;
+		return true;
+	}
+	if ( *integration_time ) {
+
+		( *integration_time )--;
+		return true;
+	}
+	return false;
+}
+
+// Shot noise limited SNR of the visible channel of summed frames
+inline bool sqm_snr_reached( uint32_t visible, uint32_t full, uint32_t ir )
+{
+	return ( visible >= SQM_MIN_VISIBLE ) && ( visible >= SQM_TARGET_SNR * sqrtf( static_cast<float>( full + ir )));
+}
+
+//
+// Counts scale with gain x integration time: from the last converged reading, pick the setting expected to give
+// enough visible counts without saturating. The settings are walked by increasing exposure, which also favours
+// a longer integration time over a higher gain. Returns false if there is no recent reading to start from.
+//
+inline bool sqm_predict_setting( const sqm_warm_start_t &warm_start, time_t now, uint8_t *gain, uint8_t *integration_time )
+{
+	if ( !warm_start.timestamp || ( now < warm_start.timestamp ) || (( now - warm_start.timestamp ) > SQM_WARM_START_MAX_AGE ))
+		return false;
+
+	if (( warm_start.gain > SQM_MAX_GAIN ) || ( warm_start.integration_time > SQM_MAX_INTEGRATION_TIME ))
+		return false;
+
+	float exposure	= static_cast<float>( SQM_GAIN_FACTOR[ warm_start.gain >> 4 ] ) * SQM_INTEGRATION_TIME[ warm_start.integration_time ];
+	float full		= warm_start.full_luminosity / exposure;
+	float visible	= warm_start.visible_luminosity / exposure;
+
+	for ( uint8_t g = 0; g < SQM_GAIN_FACTOR.size(); g++ )
+		for ( uint8_t t = 0; t < SQM_INTEGRATION_TIME.size(); t++ ) {
+
+			exposure = static_cast<float>( SQM_GAIN_FACTOR[ g ] ) * SQM_INTEGRATION_TIME[ t ];
+			if ( full * exposure > SQM_PREDICTED_MAX_FULL )
+				return true;
+
+			*gain = g << 4;
+			*integration_time = t;
+			if ( visible * exposure >= SQM_PREDICTED_MIN_VISIBLE )
+				return true;
+		}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+  	wake_tracer.cpp
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "wake_tracer.h"
+
+#if WAKE_TRACING
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+const std::array<const char *, WAKE_PHASE_COUNT> WAKE_PHASE_NAME = { "config_load", "firmware_sha", "battery", "network", "sensors", "sqm", "sd_write", "lorawan_tx" };
+
+// Rolling statistics survive deep sleep, the per-wake timings are reset at each boot and at the end of each wake
+RTC_DATA_ATTR wake_phase_summary_t					wake_phase_stats;		// NOSONAR
+RTC_DATA_ATTR std::array<int64_t, WAKE_PHASE_COUNT>	wake_phase_start_us;	// NOSONAR
+RTC_DATA_ATTR std::array<int64_t, WAKE_PHASE_COUNT>	wake_phase_elapsed_us;	// NOSONAR
+RTC_DATA_ATTR uint16_t								wake_phases_seen = 0;	// NOSONAR
+
+void WakeTracer::begin( bool warm_wake )
+{
+	if ( !warm_wake )
+		memset( wake_phase_stats.data(), 0, sizeof( wake_phase_summary_t ));
+
+	wake_phase_start_us.fill( 0 );
+	wake_phase_elapsed_us.fill( 0 );
+	wake_phases_seen = 0;
+}
+
+void WakeTracer::end_of_wake( bool debug_mode )
+{
+	for ( uint8_t i = 0; i < WAKE_PHASE_COUNT; i++ ) {
+
+		if ( !( wake_phases_seen & ( 1 << i )))
+			continue;
+
+		int64_t				elapsed_ms	= wake_phase_elapsed_us[ i ] / 1000;
+		uint16_t			ms			= ( elapsed_ms > UINT16_MAX ) ? UINT16_MAX : static_cast<uint16_t>( elapsed_ms );
+		wake_phase_stats_t	&stats		= wake_phase_stats[ i ];
+
+		if ( !stats.samples ) {
+
+			stats.min_ms = ms;
+			stats.avg_ms = ms;
+			stats.max_ms = ms;
+
+		} else {
+
+			if ( ms < stats.min_ms )
+				stats.min_ms = ms;
+			if ( ms > stats.max_ms )
+				stats.max_ms = ms;
+
+			// Exponential moving average over roughly the last 8 wakes
+			stats.avg_ms = static_cast<uint16_t>( stats.avg_ms + ( static_cast<int32_t>( ms ) - stats.avg_ms ) / 8 );
+		}
+
+		if ( stats.samples < UINT16_MAX )
+			stats.samples++;
+
+		if ( debug_mode )
+			Serial.printf( "[WAKETRACE ] [DEBUG] %-12s: %5dms (min=%5dms avg=%5dms max=%5dms)\n", WAKE_PHASE_NAME[ i ], ms, stats.min_ms, stats.avg_ms, stats.max_ms );
+	}
+
+	// Without deep sleep in between, the next wake starts from zero as well
+	wake_phase_elapsed_us.fill( 0 );
+	wake_phases_seen = 0;
+
+	if ( debug_mode )
+		Serial.printf( "[WAKETRACE ] [DEBUG] Awake for %lldms.\n", esp_timer_get_time() / 1000 );
+}
+
+void WakeTracer::get_summary( wake_phase_summary_t &summary )
+{
+	summary = wake_phase_stats;
+}
+
+const char *WakeTracer::get_phase_name( uint8_t phase )
+{
+	return ( phase < WAKE_PHASE_COUNT ) ? WAKE_PHASE_NAME[ phase ] : "unknown";
+}
+
+void WakeTracer::start( wake_phase_t phase )
+{
+	auto i = static_cast<uint8_t>( phase );
+
+	wake_phase_start_us[ i ] = esp_timer_get_time();
+	wake_phases_seen |= ( 1 << i );
+}
+
+void WakeTracer::stop( wake_phase_t phase )
+{
+	auto i = static_cast<uint8_t>( phase );
+
+	wake_phase_elapsed_us[ i ] += esp_timer_get_time() - wake_phase_start_us[ i ];
+}
+
+#endif
@@ -0,0 +1,91 @@
+/*
+  	wake_tracer.h
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef _wake_tracer_H
+#define _wake_tracer_H
+
+#include <array>
+#include <stdint.h>
+
+// Build with -DWAKE_TRACING=0 to compile the tracer out entirely
+#ifndef WAKE_TRACING
+#define WAKE_TRACING	1
+#endif
+
+enum struct wake_phase_t : uint8_t {
+
+	CONFIG_LOAD,
+	FIRMWARE_SHA,
+	BATTERY,
+	NETWORK,
+	SENSORS,
+	SQM,
+	SD_WRITE,
+	LORAWAN_TX
+};
+
+const uint8_t WAKE_PHASE_COUNT = 8;
+
+struct wake_phase_stats_t {
+
+	uint16_t	min_ms;
+	uint16_t	avg_ms;
+	uint16_t	max_ms;
+	uint16_t	samples;
+};
+
+using wake_phase_summary_t = std::array<wake_phase_stats_t, WAKE_PHASE_COUNT>;
+
+class WakeTracer {
+
+	public:
+
+		static void			begin( bool );
+		static void			end_of_wake( bool );
+		static void			get_summary( wake_phase_summary_t & );
+		static const char	*get_phase_name( uint8_t );
+		static void			start( wake_phase_t );
+		static void			stop( wake_phase_t );
+};
+
+class WakeTraceScope {
+
+	public:
+
+		explicit	WakeTraceScope( wake_phase_t _phase ) : phase( _phase ) { WakeTracer::start( phase ); }
+					~WakeTraceScope( void ) { WakeTracer::stop( phase ); }
+
+					WakeTraceScope( const WakeTraceScope & ) = delete;
+		void		operator=( const WakeTraceScope & ) = delete;
+
+	private:
+
+		wake_phase_t	phase;
+};
+
+#if WAKE_TRACING
+#define WAKE_TRACE_CONCAT_( a, b )	a##b
+#define WAKE_TRACE_CONCAT( a, b )	WAKE_TRACE_CONCAT_( a, b )
+#define WAKE_TRACE( phase )			WakeTraceScope WAKE_TRACE_CONCAT( _wake_trace_, __LINE__ )( phase )
+#else
+#define WAKE_TRACE( phase )
+#endif
+
+#endif
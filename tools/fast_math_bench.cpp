@@ -0,0 +1,142 @@
+/*
+  	fast_math_bench.cpp
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//
+// Host check and benchmark of fast_math.h: error of each kernel against the double precision C library over the
+// ranges the sensor formulas use, then the time per call against libm in float and in double.
+//
+//	g++ -std=c++17 -O2 -Wall -I src -o fast_math_bench tools/fast_math_bench.cpp -lm
+//
+// The timings only compare the kernels on the host: on the ESP32, double precision is emulated in software and
+// the gap with the float kernels is much wider. Exits with 1 if an error exceeds its bound.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+
+#include "fast_math.h"
+
+const int SAMPLES = 1000000;
+
+struct accuracy_t {
+
+	const char	*name;
+	bool		relative;
+	double		bound;
+	double		low;
+	double		high;
+	bool		log_spaced;
+	double		( *fast )( double );
+	double		( *exact )( double );
+};
+
+// Exact value at the float nearest to x, so that the rounding of the argument is not counted as an error
+double as_float( double x )			{ return static_cast<float>( x ); }
+double nelm_exact( double msas )	{ return 7.93 - 5. * log10( pow( 10., 4.316 - msas / 5. ) + 1. ); }
+double nelm_fast( double msas )		{ return 7.93F - 5.F * fast_log10f( fast_exp10f( 4.316F - ( static_cast<float>( msas ) / 5.F )) + 1.F ); }
+double msas_exact( double lux )		{ return log10( lux / 108000. ) / -.4; }
+double msas_fast( double lux )		{ return fast_log10f( static_cast<float>( lux ) / 108000.F ) / -.4F; }
+double ch0_exact( double temp )		{ return .9759 + .00192947 * pow( temp, .783129 ); }
+double ch0_fast( double temp )		{ return .9759F + .00192947F * fast_powf( static_cast<float>( temp ), .783129F ); }
+double leq_exact( double power )	{ return 10. * log10( power ); }
+double leq_fast( double power )		{ return power_to_db( static_cast<float>( power )); }
+
+double measure_error( const accuracy_t &test, double *worst_x )
+{
+	double worst = 0;
+
+	for ( int i = 0; i <= SAMPLES; i++ ) {
+
+		double f = static_cast<double>( i ) / SAMPLES;
+		double x = test.log_spaced ? test.low * pow( test.high / test.low, f ) : test.low + ( test.high - test.low ) * f;
+		double exact = test.exact( x );
+		double error = fabs( test.fast( x ) - exact );
+
+		if ( test.relative )
+			error /= fabs( exact );
+		if ( error > worst ) {
+
+			worst = error;
+			*worst_x = x;
+		}
+	}
+	return worst;
+}
+
+template <typename Function>
+double ns_per_call( Function function )
+{
+	volatile float	sink	= 0;
+	float			sum		= 0;
+	auto			start	= std::chrono::steady_clock::now();
+
+	for ( int i = 1; i <= SAMPLES; i++ )
+		sum += function( static_cast<float>( i ) * 1e-3F );
+	sink = sum;
+	( void ) sink;
+
+	return std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / SAMPLES;
+}
+
+int main( void )
+{
+	// Absolute errors include the rounding of the float result: 7.6e-6 around 128 for log2 of denormals
+	const accuracy_t tests[] = {
+
+		{ "log2 (absolute)",		false,	4e-6,	1e-30,	1e30,	true,	[]( double x ) -> double { return fast_log2f( static_cast<float>( x )); },		[]( double x ) { return log2( x ); } },
+		{ "log2 denormals",			false,	8e-6,	1e-44,	1e-38,	true,	[]( double x ) -> double { return fast_log2f( static_cast<float>( x )); },		[]( double x ) { return log2( as_float( x )); } },
+		{ "exp2 (relative)",		true,	3e-6,	-125,	127,	false,	[]( double x ) -> double { return fast_exp2f( static_cast<float>( x )); },		[]( double x ) { return exp2( as_float( x )); } },
+		{ "exp (relative)",			true,	5e-6,	-20,	20,		false,	[]( double x ) -> double { return fast_expf( static_cast<float>( x )); },		[]( double x ) { return exp( as_float( x )); } },
+		{ "MSAS from lux (mag)",	false,	2e-5,	1e-6,	1e5,	true,	msas_fast,																		msas_exact },
+		{ "NELM (mag)",				false,	5e-6,	0,		30,		false,	nelm_fast,																		nelm_exact },
+		{ "TSL2591 ch0 factor",		true,	1e-6,	0,		60,		false,	ch0_fast,																		ch0_exact },
+		{ "dB from power (dB)",		false,	1e-4,	1,		1e15,	true,	leq_fast,																		leq_exact }
+	};
+	double	worst_x	= 0;
+	bool	ok		= true;
+
+	printf( "Accuracy against the double precision C library\n" );
+	for ( const accuracy_t &test : tests ) {
+
+		double error = measure_error( test, &worst_x );
+
+		ok &= ( error <= test.bound );
+		printf( "  %-22s max error %.2e at %-12g bound %.0e %s\n", test.name, error, worst_x, test.bound, ( error <= test.bound ) ? "" : "EXCEEDED" );
+	}
+
+	double table_error = 0;
+	for ( unsigned db = 0; db < DB_POWER_TABLE.size(); db++ )
+		table_error = std::max( table_error, fabs( DB_POWER_TABLE[ db ] - pow( 10., db / 10. )) / pow( 10., db / 10. ));
+	ok &= ( table_error <= 1e-7 );
+	printf( "  %-22s max error %.2e over 0..255 dB\n", "dB to power table", table_error );
+
+	printf( "Time per call on this host (ns): fast / libm float / libm double\n" );
+	printf( "  log10  %6.2f %6.2f %6.2f\n", ns_per_call( fast_log10f ), ns_per_call( log10f ), ns_per_call( []( float x ) { return static_cast<float>( log10( static_cast<double>( x ))); } ));
+	printf( "  exp10  %6.2f %6.2f %6.2f\n", ns_per_call( []( float x ) { return fast_exp10f( x * 1e-3F ); } ), ns_per_call( []( float x ) { return powf( 10.F, x * 1e-3F ); } ),
+		ns_per_call( []( float x ) { return static_cast<float>( pow( 10., x * 1e-3 )); } ));
+	printf( "  pow    %6.2f %6.2f %6.2f\n", ns_per_call( []( float x ) { return fast_powf( x, .783129F ); } ), ns_per_call( []( float x ) { return powf( x, .783129F ); } ),
+		ns_per_call( []( float x ) { return static_cast<float>( pow( static_cast<double>( x ), .783129 )); } ));
+	printf( "  dB->pw %6.2f %6.2f %6.2f\n", ns_per_call( []( float x ) { return db_to_power( static_cast<uint8_t>( x )); } ), ns_per_call( []( float x ) { return powf( 10.F, static_cast<uint8_t>( x ) / 10.F ); } ),
+		ns_per_call( []( float x ) { return static_cast<float>( pow( 10., static_cast<uint8_t>( x ) / 10. )); } ));
+
+	printf( ok ? "OK\n" : "FAILED\n" );
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/*
+  	json_writer_bench.cpp
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//
+// Host check and benchmark of JsonBufferWriter: exact output of a small document (separators, escaping, non finite
+// floats), clean stop when the buffer is full, then the time taken to render a document shaped like the sensor data
+// JSON (35 floats, nested objects and arrays, a static fragment).
+//
+// The timing is of JsonBufferWriter alone. The former JsonDocument path needs ArduinoJson, which is installed with
+// the Arduino libraries and is not part of this tree, so this program does not compare the two.
+//
+//	g++ -std=c++17 -O2 -Wall -I src -o json_writer_bench tools/json_writer_bench.cpp src/json_writer.cpp -lm
+//
+// Exits with 1 if a check fails.
+//
+
+#include <chrono>
+#include <initializer_list>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json_writer.h"
+
+const size_t	DATA_JSON_STRING_MAXLEN	= 2560;		// Same as common.h
+const int		ITERATIONS				= 100000;
+
+bool check( const char *what, const char *result, const char *expected )
+{
+	if ( !strcmp( result, expected ))
+		return true;
+
+	printf( "  %s:\n    got      %s\n    expected %s\n", what, result, expected );
+	return false;
+}
+
+bool check_output( void )
+{
+	char				buffer[ 256 ];
+	JsonBufferWriter	json( buffer, sizeof( buffer ));
+	bool				ok;
+
+	json.begin_object();
+	json.add( "a", 1.5f );
+	json.add( "b", NAN );
+	json.add( "c", static_cast<long>( -3 ));
+	json.add( "d", "quote\" backslash\\ tab\t bell\a" );
+	json.begin_array( "e" );
+	json.add_value( 1UL );
+	json.add_value( 2UL );
+	json.end_array();
+	json.begin_object( "f" );
+	json.add( "g", true );
+	json.end_object();
+	json.add_fragment( "\"h\":0", 5 );
+	json.end_object();
+
+	ok = check( "small document", buffer, "{\"a\":1.5,\"b\":null,\"c\":-3,\"d\":\"quote\\\" backslash\\\\ tab\\t bell\\u0007\",\"e\":[1,2],\"f\":{\"g\":true},\"h\":0}" );
+	ok &= !json.overflowed() && ( json.size() == strlen( buffer ));
+
+	// Once full, the writer keeps a NUL terminated prefix and reports the overflow
+	char				small[ 16 ];
+	JsonBufferWriter	truncated( small, sizeof( small ));
+
+	truncated.begin_object();
+	truncated.add( "temperature", 12.34f );
+	truncated.add( "rh", 56.7f );
+	truncated.end_object();
+
+	if ( !truncated.overflowed() || ( strlen( small ) >= sizeof( small )) || ( truncated.size() != strlen( small ))) {
+
+		printf( "  overflow not reported or buffer not terminated\n" );
+		ok = false;
+	}
+	return ok;
+}
+
+size_t render_sensor_data( char *buffer, size_t size, const char *fragment, size_t fragment_len, int seed )
+{
+	static const char *sensor_keys[] = {
+
+		"temperature", "pressure", "sl_pressure", "rh", "dew_point", "ambient_temperature", "raw_sky_temperature",
+		"sky_temperature", "cloud_cover", "lux", "irradiance", "full", "ir", "visible", "msas", "nelm", "db",
+		"leq", "l10", "l50", "l90", "lmax", "battery_level", "panel_voltage", "latitude", "longitude", "altitude",
+		"gain", "integration_time", "exposure_ms", "fs_free_space", "heap_free", "heap_min", "rssi", "snr"
+	};
+	JsonBufferWriter json( buffer, size );
+	float v = static_cast<float>( seed ) * .01f;
+
+	json.begin_object();
+	json.add_fragment( fragment, fragment_len );
+	json.add( "timestamp", static_cast<unsigned long>( 1760000000UL + seed ));
+	json.add( "available_sensors", static_cast<unsigned long>( 0x807 ));
+	for ( const char *key : sensor_keys )
+		json.add( key, v += 1.2345f );
+
+	json.begin_array( "octaves" );
+	for ( unsigned long i = 0; i < 7; i++ )
+		json.add_value( 30 + 5 * i );
+	json.end_array();
+
+	json.begin_object( "acquisition" );
+	for ( const char *sensor : { "bme", "mlx", "tsl", "spl" } ) {
+
+		json.begin_object( sensor );
+		json.add( "interval_ms", static_cast<unsigned long>( 60000 ));
+		json.add( "jitter_ms", static_cast<unsigned long>( 12 ));
+		json.add( "missed", static_cast<unsigned long>( 0 ));
+		json.add( "failures", static_cast<unsigned long>( 1 ));
+		json.end_object();
+	}
+	json.end_object();
+	json.end_object();
+
+	return json.overflowed() ? 0 : json.size();
+}
+
+int main( void )
+{
+	static char	buffer[ DATA_JSON_STRING_MAXLEN ];
+	char		fragment[ 256 ];
+	size_t		fragment_len;
+	size_t		len				= 0;
+	bool		ok;
+
+	JsonBufferWriter static_fields( fragment, sizeof( fragment ));
+	static_fields.add( "ota_board", "ECO_STATION_V1" );
+	static_fields.add( "ota_device", "aabbccddeeff" );
+	static_fields.add( "ota_config", "0123456789abcdef" );
+	static_fields.add( "build_id", "ab12cd3_1234" );
+	fragment_len = static_fields.size();
+
+	printf( "Output checks\n" );
+	ok = check_output();
+
+	auto start = std::chrono::steady_clock::now();
+	for ( int i = 0; i < ITERATIONS; i++ )
+		len += render_sensor_data( buffer, sizeof( buffer ), fragment, fragment_len, i );
+	auto elapsed = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count();
+
+	if ( !len ) {
+
+		printf( "  the sensor data document does not fit in %zu bytes\n", sizeof( buffer ));
+		ok = false;
+	}
+	printf( "Sensor data document: %zu bytes, %.2f us per document on this host\n", len / ITERATIONS, elapsed / ITERATIONS );
+
+	printf( ok ? "OK\n" : "FAILED\n" );
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+/*
+  	payload_schema_check.cpp
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//
+// Host check of the compact payload schemas: round trip of every format through the encoder and the decoder,
+// payload sizes and LoRa airtimes (EU868, BW125, CR4/5), size of the batches, and types of the JSON values.
+//
+//	g++ -std=c++17 -O2 -Wall -I src -o payload_schema_check tools/payload_schema_check.cpp -lm
+//
+// Exits with 1 if a decoded value is off by more than one quantisation step.
+//
+
+#include <initializer_list>
+#include <math.h>
+#include <stdio.h>
+
+#include "payload_schema.h"
+
+const size_t	LORAWAN_OVERHEAD	= 13;		// MHDR, FHDR, FPort and MIC
+const uint32_t	ALL_SENSORS_BITS	= PAYLOAD_REQUIRES_MLX | PAYLOAD_REQUIRES_TSL | PAYLOAD_REQUIRES_BME | PAYLOAD_REQUIRES_SPL;
+
+struct sample_reading_t {
+
+	uint32_t	available_sensors;
+	uint8_t		sections;
+	double		offset;				// Added to the measurements, to get different readings in a batch
+};
+
+double sample_value( payload_field_t field, const sample_reading_t &sample )
+{
+	switch ( field ) {
+
+		case payload_field_t::FORMAT_VERSION:		return 0;		// Set by the caller
+		case payload_field_t::SECTIONS:				return sample.sections;
+		case payload_field_t::TIMESTAMP:			return 1760000000 + 300 * sample.offset;
+		case payload_field_t::LUX:					return 12345.6 + 10 * sample.offset;
+		case payload_field_t::IRRADIANCE:			return 98.76 + sample.offset;
+		case payload_field_t::TEMPERATURE:			return 12.34 + .1 * sample.offset;
+		case payload_field_t::PRESSURE:				return 1013.25 + .1 * sample.offset;
+		case payload_field_t::RH:					return 67.8 + .5 * sample.offset;
+		case payload_field_t::AMBIENT_TEMPERATURE:	return 11.11 + .1 * sample.offset;
+		case payload_field_t::RAW_SKY_TEMPERATURE:	return -22.22 + .2 * sample.offset;
+		case payload_field_t::SKY_TEMPERATURE:		return -25.55 + .2 * sample.offset;
+		case payload_field_t::CLOUD_COVER:			return -14.44 + .2 * sample.offset;
+		case payload_field_t::CLOUD_COVERAGE:		return 1;
+		case payload_field_t::MSAS:					return 21.37 + .01 * sample.offset;
+		case payload_field_t::NELM:					return 6.21 + .01 * sample.offset;
+		case payload_field_t::DB:					return 42 + sample.offset;
+		case payload_field_t::LEQ:					return 45.5 + sample.offset;
+		case payload_field_t::L10:					return 49 + sample.offset;
+		case payload_field_t::L50:					return 44 + sample.offset;
+		case payload_field_t::L90:					return 38 + sample.offset;
+		case payload_field_t::LMAX:					return 63 + sample.offset;
+		case payload_field_t::OCTAVE_0:
+		case payload_field_t::OCTAVE_1:
+		case payload_field_t::OCTAVE_2:
+		case payload_field_t::OCTAVE_3:
+		case payload_field_t::OCTAVE_4:
+		case payload_field_t::OCTAVE_5:
+		case payload_field_t::OCTAVE_6:				return 30 + 5 * ( static_cast<int>( field ) - static_cast<int>( payload_field_t::OCTAVE_0 ));
+		case payload_field_t::AVAILABLE_SENSORS:	return sample.available_sensors;
+		case payload_field_t::BATTERY_LEVEL:		return 87;
+		case payload_field_t::UPTIME:				return 18000 + 300 * sample.offset;
+		case payload_field_t::FS_FREE_SPACE:		return 1234567;
+		case payload_field_t::RESET_REASON:			return 8;
+		case payload_field_t::BUILD_INFO:			return 0x12345678;
+		case payload_field_t::SLEEP_MINUTES:		return 5;
+	}
+	return 0;
+}
+
+// Semtech AN1200.13, explicit header, 8 symbols preamble, low data rate optimisation at SF11 and SF12
+double lora_airtime_ms( size_t size, uint8_t sf )
+{
+	double	symbol_ms	= static_cast<double>( 1 << sf ) / 125.;
+	int		de			= ( sf >= 11 ) ? 1 : 0;
+	double	symbols		= ceil(( 8. * size - 4. * sf + 28 + 16 ) / ( 4. * ( sf - 2 * de ))) * 5;
+
+	return ( 12.25 + 8 + ( symbols > 0 ? symbols : 0 )) * symbol_ms;
+}
+
+size_t encode_sample( const payload_schema_t &schema, const sample_reading_t &sample, uint8_t *buffer, size_t size )
+{
+	return payload_encode( schema, [&schema, &sample]( payload_field_t field ) {
+
+		return ( field == payload_field_t::FORMAT_VERSION ) ? schema.version : sample_value( field, sample );
+
+	}, buffer, size );
+}
+
+// Decoded values must be within one quantisation step of the encoded ones
+bool check_round_trip( const payload_schema_t &schema, const sample_reading_t *samples, const uint8_t *buffer, size_t size )
+{
+	bool ok = true;
+
+	bool decoded = payload_decode( buffer, size, [&schema, samples, &ok]( uint8_t reading, const payload_field_desc_t &desc, double value ) {
+
+		double expected = ( desc.field == payload_field_t::FORMAT_VERSION ) ? schema.version : sample_value( desc.field, samples[ reading ] );
+
+		if ( expected < desc.min )
+			expected = desc.min;
+		else if ( expected > desc.max )
+			expected = desc.max;
+
+		if ( fabs( value - expected ) > 1. / desc.scale ) {
+
+			printf( "  0x%02x reading %d: %s decoded as %f instead of %f\n", schema.version, reading, desc.name, value, expected );
+			ok = false;
+		}
+	});
+
+	if ( !decoded ) {
+
+		printf( "  0x%02x: cannot decode the %zu bytes payload\n", schema.version, size );
+		return false;
+	}
+	return ok;
+}
+
+// Values outside of the payload range that the readings use as markers
+const struct {
+
+	payload_field_t	field;
+	double			value;
+
+} JSON_SENTINELS[] = {
+
+	{ payload_field_t::LUX, -1 }
+};
+
+// A field that can be negative, in its range or as a marker, must not come out as an unsigned JSON value
+bool check_json_types( void )
+{
+	bool ok = true;
+
+	for ( const payload_schema_t &schema : PAYLOAD_SCHEMAS )
+		for ( size_t i = 0; i < schema.count; i++ ) {
+
+			const payload_field_desc_t	&desc		= schema.fields[ i ];
+			bool						negative	= ( desc.min < 0 );
+
+			for ( const auto &sentinel : JSON_SENTINELS )
+				negative |= (( sentinel.field == desc.field ) && ( sentinel.value < 0 ));
+
+			if ( negative && ( payload_json_type( desc.field ) == payload_json_t::UNSIGNED )) {
+
+				printf( "  0x%02x: %s can be negative but is written as an unsigned JSON value\n", schema.version, desc.name );
+				ok = false;
+			}
+		}
+
+	return ok;
+}
+
+int main( void )
+{
+	const sample_reading_t cases[] = {
+
+		{ ALL_SENSORS_BITS, 0, 0 },
+		{ ALL_SENSORS_BITS, PAYLOAD_SECTION_EXTENDED_HEALTH, 0 },
+		{ ALL_SENSORS_BITS, PAYLOAD_SECTION_EXTENDED_HEALTH | PAYLOAD_SECTION_SPECTRUM, 0 },
+		{ 0, 0, 0 }
+	};
+	const char *case_names[] = { "all sensors", "+ extended health", "+ health and spectrum", "no sensors" };
+	uint8_t	buffer[ 512 ];
+	size_t	size;
+	bool	ok = true;
+
+	printf( "Single readings (payload bytes, airtime with %zu bytes of LoRaWAN overhead)\n", LORAWAN_OVERHEAD );
+	for ( const payload_schema_t &schema : PAYLOAD_SCHEMAS ) {
+
+		for ( uint8_t i = 0; i < sizeof( cases ) / sizeof( cases[0] ); i++ ) {
+
+			// Formats before 0x04 always send everything
+			if (( schema.version < 0x04 ) && i )
+				continue;
+
+			if ( !( size = encode_sample( schema, cases[ i ], buffer, sizeof( buffer )))) {
+
+				printf( "  0x%02x %s: encoding failed\n", schema.version, case_names[ i ] );
+				ok = false;
+				continue;
+			}
+			ok &= check_round_trip( schema, &cases[ i ], buffer, size );
+			printf( "  0x%02x %-22s %3zu bytes  SF12 %5.0f ms  SF10 %4.0f ms  SF7 %4.0f ms\n", schema.version, case_names[ i ], size,
+				lora_airtime_ms( size + LORAWAN_OVERHEAD, 12 ), lora_airtime_ms( size + LORAWAN_OVERHEAD, 10 ), lora_airtime_ms( size + LORAWAN_OVERHEAD, 7 ));
+		}
+	}
+
+	printf( "Batches of format 0x%02x readings, all sensors\n", COMPACT_DATA_FORMAT_VERSION );
+	for ( uint8_t count : { 2, 4, 8, 16 } ) {
+
+		sample_reading_t	samples[ PAYLOAD_BATCH_MAX_READINGS ];
+		uint8_t				frames[ PAYLOAD_BATCH_MAX_READINGS ][ 64 ];
+		const uint8_t		*frame_ptrs[ PAYLOAD_BATCH_MAX_READINGS ];
+		size_t				sizes[ PAYLOAD_BATCH_MAX_READINGS ];
+		size_t				total = 0;
+		const payload_schema_t *schema = payload_get_schema( COMPACT_DATA_FORMAT_VERSION );
+
+		for ( uint8_t k = 0; k < count; k++ ) {
+
+			samples[ k ] = { ALL_SENSORS_BITS, 0, static_cast<double>( k ) };
+			sizes[ k ] = encode_sample( *schema, samples[ k ], frames[ k ], sizeof( frames[ k ] ));
+			frame_ptrs[ k ] = frames[ k ];
+			total += sizes[ k ];
+		}
+
+		if ( !( size = payload_encode_batch( frame_ptrs, sizes, count, buffer, sizeof( buffer )))) {
+
+			printf( "  %2d readings: batching failed\n", count );
+			ok = false;
+			continue;
+		}
+		ok &= check_round_trip( *schema, samples, buffer, size );
+		printf( "  %2d readings: %3zu bytes instead of %3zu, fits at DR0 %s, DR3 %s, DR5 %s\n", count, size, total,
+			( size <= 51 ) ? "yes" : "no ", ( size <= 115 ) ? "yes" : "no ", ( size <= 222 ) ? "yes" : "no " );
+	}
+
+	printf( "JSON types\n" );
+	ok &= check_json_types();
+
+	printf( ok ? "OK\n" : "FAILED\n" );
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*
+  	sqm_ranging_bench.cpp
+
+	(c) 2026 F.Lesage
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your option)
+	any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//
+// Host benchmark of the SQM auto-ranging on sky brightness traces: number of settings tried and time spent per
+// reading, starting from the lowest setting (cold start) or from sqm_predict_setting() (warm start).
+//
+//	g++ -std=c++17 -O2 -Wall -I src -o sqm_ranging_bench tools/sqm_ranging_bench.cpp -lm
+//
+// The TSL2591 is simulated: counts proportional to lux x gain x integration time, 30% of infrared, clipped at the
+// full scale of the ADC. The loops of SQM::get_msas_nelm() and SQM::read_long_exposure() are replayed here since
+// they drive the sensor, but the ladder, the saturation check, the frame duration and the SNR stop are the
+// firmware's own, from sqm_ranging.h.
+// Exits with 1 if a reading does not converge to a valid exposure.
+//
+
+#include <initializer_list>
+#include <math.h>
+#include <stdio.h>
+
+#include "sqm_ranging.h"
+
+const float		IR_RATIO				= .3F;
+const uint32_t	MAX_EXPOSURE_MS			= 20000;	// Default sqm_max_exposure
+const time_t	READING_INTERVAL		= 300;		// Default sqm_period
+
+struct trace_t {
+
+	const char	*name;
+	float		( *msas )( int );		// Sky brightness of the nth reading
+	int			readings;
+};
+
+struct run_stats_t {
+
+	uint32_t	settings		= 0;
+	uint32_t	max_settings	= 0;
+	uint32_t	ranging_ms		= 0;		// Before the long exposure
+	uint32_t	time_ms			= 0;
+	bool		ok				= true;
+};
+
+// 3 hours from daylight to a dark sky
+float dusk( int i )		{ return ( i < 24 ) ? 3.F + 18.5F * i / 24 : 21.5F; }
+float dark_site( int )	{ return 21.8F; }
+float moonrise( int i )	{ return ( i < 18 ) ? 21.5F : 18.F; }
+float headlights( int i ){ return ( i == 10 ) ? 12.F : 20.5F; }
+
+void expose( float lux, uint8_t gain, uint8_t integration_time, uint32_t *full, uint32_t *ir, bool *saturated )
+{
+	float		cpl			= static_cast<float>( SQM_GAIN_FACTOR[ gain >> 4 ] ) * SQM_INTEGRATION_TIME[ integration_time ] / 408.F;
+	float		counts		= lux * cpl / (( 1.F - IR_RATIO ) * ( 1.F - IR_RATIO ));
+	uint32_t	max_count	= integration_time ? UINT16_MAX : SQM_MAX_COUNT_100MS;
+
+	*full = ( counts >= max_count ) ? max_count : static_cast<uint32_t>( counts );
+	*ir = static_cast<uint32_t>( *full * IR_RATIO );
+	*saturated = sqm_saturated( integration_time, *full, *ir );
+}
+
+// One reading: returns false if no valid exposure was found
+bool read_sqm( float lux, time_t now, bool warm, sqm_warm_start_t &warm_start, uint32_t *settings, uint32_t *ranging_ms, uint32_t *time_ms )
+{
+	uint8_t		gain				= 0;
+	uint8_t		integration_time	= 0;
+	uint32_t	full;
+	uint32_t	ir;
+	bool		saturated;
+
+	if ( warm )
+		sqm_predict_setting( warm_start, now, &gain, &integration_time );
+
+	*ranging_ms = 0;
+	*time_ms = 0;
+	for ( *settings = 1; *settings <= SQM_MAX_SETTINGS; ( *settings )++ ) {
+
+		expose( lux, gain, integration_time, &full, &ir, &saturated );
+		*time_ms += sqm_frame_ms( integration_time );
+
+		uint32_t	visible	= full - ir;
+		uint16_t	frames	= 1;
+
+		if ( visible < SQM_MIN_VISIBLE ) {
+
+			if ( sqm_more_exposure( &gain, &integration_time ))
+				continue;
+
+			*ranging_ms = *time_ms;
+			while ( !sqm_snr_reached( visible, full, ir ) && (( frames + 1U ) * sqm_frame_ms( integration_time ) <= MAX_EXPOSURE_MS ) && ( frames < SQM_MAX_FRAMES )) {
+
+				uint32_t frame_full;
+				uint32_t frame_ir;
+
+				expose( lux, gain, integration_time, &frame_full, &frame_ir, &saturated );
+				full += frame_full;
+				ir += frame_ir;
+				visible = full - ir;
+				frames++;
+				*time_ms += sqm_frame_ms( integration_time );
+			}
+
+		} else if ( saturated ) {
+
+			if ( sqm_less_exposure( &gain, &integration_time ))
+				continue;
+
+			*ranging_ms = *time_ms;
+			return true;		// Too bright, reported as such
+		}
+
+		if ( !*ranging_ms )
+			*ranging_ms = *time_ms;
+		warm_start = { now, gain, integration_time, full / frames, visible / frames };
+		return true;
+	}
+	return false;
+}
+
+run_stats_t run_trace( const trace_t &trace, bool warm )
+{
+	run_stats_t			stats;
+	sqm_warm_start_t	warm_start	= {};
+	uint32_t			settings;
+	uint32_t			ranging_ms;
+	uint32_t			time_ms;
+
+	for ( int i = 0; i < trace.readings; i++ ) {
+
+		float lux = 108000.F * powf( 10.F, -.4F * trace.msas( i ));
+
+		if ( !read_sqm( lux, 1760000000 + i * READING_INTERVAL, warm, warm_start, &settings, &ranging_ms, &time_ms )) {
+
+			printf( "  %s, %s start: reading %d at %.2f MPSAS did not converge\n", trace.name, warm ? "warm" : "cold", i, trace.msas( i ));
+			stats.ok = false;
+		}
+		stats.settings += settings;
+		stats.ranging_ms += ranging_ms;
+		stats.time_ms += time_ms;
+		if ( settings > stats.max_settings )
+			stats.max_settings = settings;
+	}
+	return stats;
+}
+
+int main( void )
+{
+	const trace_t traces[] = {
+
+		{ "dusk to dark sky",	dusk,		36 },
+		{ "dark site 21.8",		dark_site,	36 },
+		{ "moonrise",			moonrise,	36 },
+		{ "headlights",			headlights,	36 }
+	};
+	bool ok = true;
+
+	printf( "%-18s %-5s %13s %13s %15s %13s\n", "trace", "start", "avg settings", "max settings", "avg ranging ms", "avg total ms" );
+	for ( const trace_t &trace : traces )
+		for ( bool warm : { false, true } ) {
+
+			run_stats_t stats = run_trace( trace, warm );
+
+			ok &= stats.ok;
+			printf( "%-18s %-5s %13.1f %13u %15u %13u\n", trace.name, warm ? "warm" : "cold", static_cast<float>( stats.settings ) / trace.readings, stats.max_settings, stats.ranging_ms / trace.readings, stats.time_ms / trace.readings );
+		}
+
+	printf( ok ? "OK\n" : "FAILED\n" );
+	return ok ? 0 : 1;
+}